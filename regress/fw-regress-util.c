@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Helper for the fw-regress harness
+ *
+ *   fw-regress-util gen <seed> <size> <file>
+ *	writes size bytes of xorshift64 noise to file, the same bytes for
+ *	the same seed on every host
+ *
+ *   fw-regress-util uimage <file> <uimage>
+ *	wraps file in a legacy U-Boot header (MIPS Linux kernel, not
+ *	compressed) for the tools that only take uImages
+ *
+ *   fw-regress-util srec <file> <srec>
+ *	writes file as Motorola S3 records loaded at 0x80010000
+ *
+ *   fw-regress-util run <result> <command> [<args>...]
+ *	runs command and writes "<wall ns> <cycles> <peak rss KiB>" to
+ *	result.  Cycles come from the cycle counter where perf events are
+ *	allowed and are estimated from the CPU time and the clock rate in
+ *	/proc/cpuinfo otherwise.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#define UIMAGE_MAGIC	0x27051956
+#define SREC_ADDR	0x80010000
+
+static int gen(uint64_t seed, unsigned long long size, const char *path)
+{
+	uint64_t x = seed ? seed : 0x9e3779b97f4a7c15ULL;
+	unsigned char buf[0x10000];
+	size_t i, len;
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return 1;
+	}
+
+	while (size) {
+		len = size < sizeof(buf) ? size : sizeof(buf);
+		for (i = 0; i < len; i++) {
+			if (!(i % 8)) {
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+			}
+			buf[i] = x >> (8 * (i % 8));
+		}
+		if (fwrite(buf, 1, len, fp) != len)
+			break;
+		size -= len;
+	}
+
+	if (fclose(fp) || size) {
+		fprintf(stderr, "Couldn't write %s\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void *load(const char *path, size_t *len)
+{
+	unsigned char *buf = NULL;
+	size_t size = 0, n;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return NULL;
+	}
+
+	do {
+		unsigned char *tmp = realloc(buf, size + 0x10000);
+
+		if (!tmp) {
+			free(buf);
+			fclose(fp);
+			return NULL;
+		}
+		buf = tmp;
+		n = fread(buf + size, 1, 0x10000, fp);
+		size += n;
+	} while (n);
+
+	fclose(fp);
+	*len = size;
+
+	return buf;
+}
+
+static void put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int uimage(const char *in, const char *path)
+{
+	unsigned char hdr[64] = { 0 };
+	unsigned char *data;
+	size_t len;
+	FILE *fp;
+	int err;
+
+	data = load(in, &len);
+	if (!data)
+		return 1;
+
+	put_be32(hdr, UIMAGE_MAGIC);
+	put_be32(hdr + 12, len);
+	put_be32(hdr + 16, 0x80060000);		/* load address */
+	put_be32(hdr + 20, 0x80060000);		/* entry point */
+	put_be32(hdr + 24, crc32(0, data, len));
+	hdr[28] = 5;				/* Linux */
+	hdr[29] = 5;				/* MIPS */
+	hdr[30] = 2;				/* kernel */
+	strcpy((char *)hdr + 32, "fw-regress");
+	put_be32(hdr + 4, crc32(0, hdr, sizeof(hdr)));
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		free(data);
+		return 1;
+	}
+	fwrite(hdr, 1, sizeof(hdr), fp);
+	fwrite(data, 1, len, fp);
+	err = ferror(fp) | fclose(fp);
+	free(data);
+
+	return err ? 1 : 0;
+}
+
+static void srec_line(FILE *fp, char type, uint32_t addr, int addr_len,
+		      const unsigned char *data, size_t len)
+{
+	unsigned int sum = addr_len + len + 1;
+	int i;
+
+	fprintf(fp, "S%c%02X", type, (unsigned int)(addr_len + len + 1));
+	for (i = addr_len - 1; i >= 0; i--) {
+		fprintf(fp, "%02X", (addr >> (8 * i)) & 0xff);
+		sum += (addr >> (8 * i)) & 0xff;
+	}
+	for (i = 0; i < len; i++) {
+		fprintf(fp, "%02X", data[i]);
+		sum += data[i];
+	}
+	fprintf(fp, "%02X\n", ~sum & 0xff);
+}
+
+static int srec(const char *in, const char *path)
+{
+	unsigned char *data;
+	size_t len, i;
+	FILE *fp;
+	int err;
+
+	data = load(in, &len);
+	if (!data)
+		return 1;
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		free(data);
+		return 1;
+	}
+	srec_line(fp, '0', 0, 2, (const unsigned char *)"fw-regress", 10);
+	for (i = 0; i < len; i += 16)
+		srec_line(fp, '3', SREC_ADDR + i, 4, data + i, len - i < 16 ? len - i : 16);
+	srec_line(fp, '7', SREC_ADDR, 4, NULL, 0);
+	err = ferror(fp) | fclose(fp);
+	free(data);
+
+	return err ? 1 : 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cycles_open(void)
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.enable_on_exec = 1;
+	attr.exclude_hv = 1;
+
+	/* counts the child once it execs, the fork is done without it */
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd < 0 && errno == EACCES) {
+		/* perf_event_paranoid 2 only allows counting user space */
+		attr.exclude_kernel = 1;
+		fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+/* rough fallback when the cycle counter is not available */
+static uint64_t cycles_estimate(const struct rusage *ru)
+{
+	uint64_t us;
+	double mhz = 0;
+	char line[256];
+	FILE *fp;
+
+	us = (uint64_t)ru->ru_utime.tv_sec * 1000000 + ru->ru_utime.tv_usec +
+	     (uint64_t)ru->ru_stime.tv_sec * 1000000 + ru->ru_stime.tv_usec;
+
+	fp = fopen("/proc/cpuinfo", "r");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp))
+			if (sscanf(line, "cpu MHz : %lf", &mhz) == 1)
+				break;
+		fclose(fp);
+	}
+	if (mhz <= 0)
+		mhz = 1000;
+
+	return us * mhz;
+}
+
+static int run(const char *result, char **argv)
+{
+	uint64_t start, wall, cycles = 0;
+	struct rusage ru;
+	int fd, status;
+	pid_t pid;
+	FILE *fp;
+
+	fd = cycles_open();
+
+	start = now_ns();
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (!pid) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "Couldn't run %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
+	}
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		return 1;
+	}
+	wall = now_ns() - start;
+
+	if (fd < 0 || read(fd, &cycles, sizeof(cycles)) != sizeof(cycles) || !cycles)
+		cycles = cycles_estimate(&ru);
+	if (fd >= 0)
+		close(fd);
+
+	fp = fopen(result, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", result);
+		return 1;
+	}
+	fprintf(fp, "%llu %llu %ld\n", (unsigned long long)wall,
+		(unsigned long long)cycles, ru.ru_maxrss);
+	fclose(fp);
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+
+	return 128 + WTERMSIG(status);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: fw-regress-util gen <seed> <size> <file>\n");
+	fprintf(stderr, "       fw-regress-util uimage <file> <uimage>\n");
+	fprintf(stderr, "       fw-regress-util srec <file> <srec>\n");
+	fprintf(stderr, "       fw-regress-util run <result> <command> [<args>...]\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 5 && !strcmp(argv[1], "gen"))
+		return gen(strtoull(argv[2], NULL, 0), strtoull(argv[3], NULL, 0), argv[4]);
+
+	if (argc == 4 && !strcmp(argv[1], "uimage"))
+		return uimage(argv[2], argv[3]);
+
+	if (argc == 4 && !strcmp(argv[1], "srec"))
+		return srec(argv[2], argv[3]);
+
+	if (argc >= 4 && !strcmp(argv[1], "run"))
+		return run(argv[2], &argv[3]);
+
+	usage();
+	return 1;
+}
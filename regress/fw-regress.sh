@@ -0,0 +1,312 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# fw-regress - bit-exact and throughput regression run of the image tools
+#
+# Usage: fw-regress.sh <tool dir> <fw-regress-util> <regress dir> [-u]
+#
+# Builds an image with every case below from the same synthetic inputs and
+# compares the SHA-256 of each output with golden.sha256.  For each case the
+# wall time, cycles per byte (of the largest file the case reads or writes)
+# and peak RSS are printed, and a case fails if it needs more cycles per
+# byte or memory than its line in thresholds allows.  With -u the golden
+# hashes are rewritten from this run instead.
+#
+# FW_REGRESS_RUNS sets how often each case is run (default 3); the fastest
+# run counts, which keeps the timings from being dominated by noise.
+#
+# Every tool has a case except these, which cannot work on synthetic input:
+#   bcm4908asus	needs a bcm4908img image with a valid CRC tail, and
+#		bcm4908img is not part of this tree
+#   bcmblob	only inspects Broadcom CLM blobs
+#   bcmclm	only inspects Broadcom CLM data
+#   mkzynfw	needs a real ZyNOS boot extension; with anything else it
+#		crashes or writes a 4 GiB image
+
+set -u
+
+if [ $# -lt 3 ]; then
+	echo "Usage: $0 <tool dir> <fw-regress-util> <regress dir> [-u]" >&2
+	exit 1
+fi
+
+BIN=$(cd "$1" && pwd) || exit 1
+UTIL=$(cd "$(dirname "$2")" && pwd)/$(basename "$2") || exit 1
+REGRESS=$(cd "$3" && pwd) || exit 1
+UPDATE=0
+[ "${4:-}" = "-u" ] && UPDATE=1
+RUNS=${FW_REGRESS_RUNS:-3}
+
+GOLDEN=$REGRESS/golden.sha256
+THRESHOLDS=$REGRESS/thresholds
+WORK=$BIN/fw-regress
+
+# the outputs must not depend on the host
+LC_ALL=C
+TZ=UTC
+SOURCE_DATE_EPOCH=1700000000
+export LC_ALL TZ SOURCE_DATE_EPOCH
+unset FWUTIL_STATS
+
+rm -rf "$WORK"
+mkdir -p "$WORK" || exit 1
+cd "$WORK" || exit 1
+
+# kernel and rootfs sized like a small router image, small has an odd size
+"$UTIL" gen 1 1500000 kernel &&
+"$UTIL" gen 2 3000000 rootfs &&
+"$UTIL" gen 3 4097 small &&
+"$UTIL" gen 4 0x3e0000 dg834 || exit 1
+
+# the next release: two edits, one across an erase block boundary of the
+# TRX, and a grown tail
+cp rootfs rootfs-new &&
+printf fw-regress | dd of=rootfs-new bs=1 seek=1048576 conv=notrunc 2>/dev/null &&
+printf fw-regress | dd of=rootfs-new bs=1 seek=2162683 conv=notrunc 2>/dev/null &&
+cat small >> rootfs-new || exit 1
+
+# tools that check what they wrap
+"$UTIL" uimage kernel uimage &&
+"$UTIL" srec small small.srec &&
+{ printf '\135\000\000\200'; cat kernel; } > kernel.lzma || exit 1
+
+# some tools put the input mtime into the image
+touch -d "@$SOURCE_DATE_EPOCH" kernel rootfs rootfs-new small dg834 uimage || exit 1
+
+failed=0
+: > hashes
+
+printf '%-24s %-6s %10s %12s %10s\n' case result "wall ms" cycles/byte "rss KiB"
+
+# fw_case <name> <output> <tool> [<args>...]
+#
+# Runs a tool in the work directory; an output of - means its stdout.
+# Tools that edit their input in place get a copy made before each run.
+fw_case() {
+	name=$1
+	out=$2
+	tool=$3
+	shift 3
+
+	best_ns=
+	best_cycles=
+	max_rss=0
+	run=0
+	while [ $run -lt "$RUNS" ]; do
+		[ -n "${PREPARE:-}" ] && eval "$PREPARE"
+		if ! "$UTIL" run "$name.res" "$BIN/$tool" "$@" > "$name.stdout" 2> "$name.stderr"; then
+			printf '%-24s %-6s\n' "$name" FAIL
+			sed 's/^/	/' "$name.stderr"
+			failed=1
+			PREPARE=
+			return
+		fi
+		read -r ns cycles rss < "$name.res"
+		if [ -z "$best_ns" ] || [ "$ns" -lt "$best_ns" ]; then
+			best_ns=$ns
+		fi
+		if [ -z "$best_cycles" ] || [ "$cycles" -lt "$best_cycles" ]; then
+			best_cycles=$cycles
+		fi
+		[ "$rss" -gt "$max_rss" ] && max_rss=$rss
+		run=$((run + 1))
+	done
+	PREPARE=
+
+	[ "$out" = "-" ] && out=$name.stdout
+	hash=$(sha256sum < "$out" | cut -d' ' -f1)
+	size=$(wc -c < "$out")
+	for arg; do
+		[ -f "$arg" ] || continue
+		n=$(wc -c < "$arg")
+		[ "$n" -gt "$size" ] && size=$n
+	done
+	echo "$hash  $name" >> hashes
+
+	result=ok
+	if [ $UPDATE = 0 ]; then
+		golden=$(awk -v n="$name" '$2 == n { print $1 }' "$GOLDEN")
+		if [ "$hash" != "$golden" ]; then
+			result=DIFF
+		fi
+	fi
+
+	cpb=$(awk -v c="$best_cycles" -v s="$size" 'BEGIN { printf "%.2f", s ? c / s : 0 }')
+	limit=$(awk -v n="$name" '$1 == n { print $2, $3 }' "$THRESHOLDS")
+	if [ -z "$limit" ]; then
+		[ $result = ok ] && result=NOLIM
+	else
+		set -- $limit
+		if awk -v v="$cpb" -v l="$1" 'BEGIN { exit !(v > l) }'; then
+			[ $result = ok ] && result=SLOW
+		elif [ "$max_rss" -gt "$2" ]; then
+			[ $result = ok ] && result=RSS
+		fi
+	fi
+	[ $result = ok ] || failed=1
+
+	printf '%-24s %-6s %10s %12s %10s\n' "$name" $result \
+		"$(awk -v n="$best_ns" 'BEGIN { printf "%.2f", n / 1e6 }')" "$cpb" "$max_rss"
+}
+
+# TRX family
+fw_case trx trx.bin trx -o trx.bin -f kernel -a 0x10000 -f rootfs
+PREPARE='cp trx.bin trx-p.bin'
+fw_case trx-patch trx-p.bin trx -P trx-p.bin -p 0x100000 -f small
+fw_case otrx otrx.bin otrx create otrx.bin -f kernel -a 0x10000 -f rootfs
+fw_case otrx-new otrx-new.bin otrx create otrx-new.bin -f kernel -a 0x10000 -f rootfs-new
+fw_case otrx-extract otrx-2.bin otrx extract otrx.bin -2 otrx-2.bin
+PREPARE='cp otrx.bin otrx-e.bin'
+fw_case otrx-edit otrx-e.bin otrx edit otrx-e.bin -F 0x1 -V 2
+PREPARE='cp otrx.bin otrx-p.bin'
+fw_case otrx-patch otrx-p.bin otrx patch otrx-p.bin -p 0x100000 -f small
+fw_case asustrx asustrx.bin asustrx -i trx.bin -o asustrx.bin -p RT-AC68U -v 3.0.0.4
+fw_case addpattern addpattern.bin addpattern -i trx.bin -o addpattern.bin -p W54G -g
+fw_case addpattern-variants addpattern-e2100l.bin addpattern -i trx.bin -o addpattern-wrt160nl.bin -B WRT160NL -g -V E2100L:addpattern-e2100l.bin
+fw_case mkchkimg mkchkimg.bin mkchkimg -o mkchkimg.bin -k kernel -f rootfs -b U12H240T00_NETGEAR -r 1
+fw_case mkchkimg-variants mkchkimg-2.bin mkchkimg -o mkchkimg-1.bin -k kernel -f rootfs -b U12H240T00_NETGEAR -r 1 -V U12H270T00_NETGEAR:2:mkchkimg-2.bin
+fw_case motorola-bin motorola.bin motorola-bin -1 trx.bin motorola.bin
+fw_case trx2edips trx2edips.bin trx2edips trx.bin trx2edips.bin
+fw_case trx2usr trx2usr.bin trx2usr trx.bin trx2usr.bin
+fw_case zytrx zytrx.bin zytrx -B NR7101 -v foobar-1.0 -i trx.bin -o zytrx.bin
+fw_case lxlfw lxlfw.bin lxlfw create lxlfw.bin -i trx.bin -b XWR-3100 -r 7.1.0
+PREPARE='cp lxlfw.bin lxlfw-e.bin'
+fw_case lxlfw-edit lxlfw-e.bin lxlfw edit lxlfw-e.bin -b XWR-1000 -r 7.1.1
+fw_case lxlfw-extract lxlfw-x.bin lxlfw extract lxlfw.bin -O lxlfw-x.bin
+
+# partition aware deltas from trx.bin to the next release
+fw_case fwdelta fwdelta.bin fwdelta trx.bin otrx-new.bin fwdelta.bin
+fw_case fwdelta-raw fwdelta-raw.bin fwdelta -r trx.bin otrx-new.bin fwdelta-raw.bin
+fw_case fwpatch fwpatch.bin fwpatch trx.bin fwdelta.bin fwpatch.bin
+
+# erase block manifests, and the blocks to reflash from trx.bin
+fw_case otrx-manifest otrx-new.man otrx create otrx-m.bin -f kernel -a 0x10000 -f rootfs-new -m otrx-new.man
+fw_case tplink-safeloader-manifest safeloader.man tplink-safeloader -B ARCHER-C7-V4 -k kernel -r rootfs -o safeloader-m.bin -V r1 -m safeloader.man
+fw_case ptgen-manifest ptgen.man ptgen -g -h 16 -s 63 -l 1024 -p 16M -p 32M -o ptgen-m.bin -m ptgen.man
+fw_case fwflash-plan - fwflash-plan otrx-new.man trx.bin
+
+# images written to a device (a regular file here) holding the old image
+PREPARE='cp trx.bin dev-otrx.img && truncate -s 8M dev-otrx.img'
+fw_case otrx-device dev-otrx.img otrx create otrx-d.bin -f kernel -a 0x10000 -f rootfs-new -D dev-otrx.img
+PREPARE='cp trx.bin dev-trx.img && truncate -s 8M dev-trx.img'
+fw_case trx-device dev-trx.img trx -o trx-d.bin -f kernel -a 0x10000 -f rootfs-new -D dev-trx.img
+PREPARE='rm -f dev-ptgen.img && truncate -s 1M dev-ptgen.img'
+fw_case ptgen-device dev-ptgen.img ptgen -g -h 16 -s 63 -l 1024 -p 16M -p 32M -o ptgen-d.bin -D dev-ptgen.img
+
+# other containers
+fw_case seama kernel.seama seama -i kernel -m dev=/dev/mtdblock/2 -m type=firmware
+fw_case seama-seal seama-seal.bin seama -s seama-seal.bin -i kernel.seama -m signature=wrgac01_dlink.2013gui_dir868l
+fw_case oseama oseama.bin oseama entity oseama.bin -m dev=/dev/mtdblock/2 -m type=firmware -f kernel -b 0x400000
+PREPARE='cp seama-seal.bin oseama-e.bin'
+fw_case oseama-edit oseama-e.bin oseama edit oseama-e.bin -m signature=wrgac14_dlink.2015_dir880l
+fw_case imagetag imagetag.bin imagetag -i kernel -f rootfs -o imagetag.bin -b 96348GW-11 -c 6348 -s 0x10000 -n 4 -v 8 -l 0x80010000 -e 0x80010000
+PREPARE='cp imagetag.bin imagetag-p.bin'
+fw_case imagetag-patch imagetag-p.bin imagetag patch imagetag-p.bin 0x100000 small
+fw_case xiaomifw xiaomifw.bin xiaomifw create xiaomifw.bin -m r3g -b 0x200000:uimage2:firmware.bin:kernel
+fw_case xiaomifw-extract - xiaomifw extract -i xiaomifw.bin -n firmware.bin
+fw_case mkdlinkfw mkdlinkfw.bin mkdlinkfw -k kernel -r rootfs -o mkdlinkfw.bin -s 0x700000 -m DLK6E2414001 -f 0x10
+fw_case mkdlinkfw-factory mkdlinkfw-f.bin mkdlinkfw -k kernel -r rootfs -o mkdlinkfw-s.bin -W mkdlinkfw-f.bin -s 0x700000 -m DLK6E2414001 -f 0x10
+fw_case mkdlinkfw-convert mkdlinkfw-c.bin mkdlinkfw -F mkdlinkfw.bin -o mkdlinkfw-c.bin -s 0x700000 -m DLK6E2414001 -f 0x10
+fw_case tplink-safeloader safeloader.bin tplink-safeloader -B ARCHER-C7-V4 -k kernel -r rootfs -o safeloader.bin -V r1
+fw_case tplink-safeloader-sysup safeloader-s.bin tplink-safeloader -B ARCHER-C7-V4 -k kernel -r rootfs -o safeloader-s.bin -V r1 -S
+fw_case tplink-safeloader-cpe210 safeloader-cpe.bin tplink-safeloader -B CPE210 -k kernel -r rootfs -o safeloader-cpe.bin -V r1
+PREPARE='cp safeloader-cpe.bin safeloader-e.bin'
+fw_case tplink-safeloader-edit safeloader-e.bin tplink-safeloader -B CPE210 -e safeloader-e.bin -V r2
+fw_case tplink-safeloader-convert safeloader-z.bin tplink-safeloader -B ARCHER-C7-V4 -z safeloader.bin -o safeloader-z.bin
+PREPARE='rm -rf safeloader-x && mkdir safeloader-x'
+fw_case tplink-safeloader-extract safeloader-x/support-list tplink-safeloader -x safeloader.bin -d safeloader-x
+fw_case mkzyxelzldfw mkzyxelzldfw.bin mkzyxelzldfw -v 0x1 -b 0x12345678 -c 1.0 -m NWA -d abcd -i kernel -o 0 -r 1 -t kernel -x kernel mkzyxelzldfw.bin
+fw_case mkmylofw mkmylofw.bin mkmylofw -B WP54G -p0x20000:0x180000:a::kernel:kernel -p0x1a0000:0x10000:::small:small mkmylofw.bin
+fw_case mktitanimg mktitanimg.bin mktitanimg -o mktitanimg.bin -i kernel rootfs -a 0 4096
+fw_case mkrasimage mkrasimage.bin mkrasimage -k kernel -r rootfs -s 4194304 -v 1.0 -b RAS-ABC -o mkrasimage.bin
+fw_case jcgimage jcgimage.bin jcgimage -o jcgimage.bin -u kernel -v 1.0 -m 8388608
+fw_case iptime-naspkg iptime-naspkg.bin iptime-naspkg nas1 kernel iptime-naspkg.bin
+fw_case iptime-crc32 iptime-crc32.bin iptime-crc32 ax2004m kernel iptime-crc32.bin
+fw_case makeamitbin makeamitbin.bin makeamitbin -1 DDC_RUS001 -2 Queen -o makeamitbin.bin linux kernel ramdisk small
+fw_case wrt400n wrt400n.bin wrt400n kernel rootfs wrt400n.bin
+fw_case mkcameofw mkcameofw.bin mkcameofw -k kernel -r rootfs -M DIR-615 -S SIG -R WW -V 1.0 -I 0x800000 -K 0x180000 -o mkcameofw.bin
+fw_case mkcasfw mkcasfw.bin mkcasfw -B CAS-630 -K kernel mkcasfw.bin
+fw_case mkcsysimg mkcsysimg.bin mkcsysimg -B BR-6104K -r kernel:0x80500000 mkcsysimg.bin
+fw_case mkfwimage mkfwimage.bin mkfwimage -B XM -k kernel -r rootfs -o mkfwimage.bin -v XM.ar7240.v5.5
+fw_case mkfwimage2 mkfwimage2.bin mkfwimage2 -v XS.v1 -o mkfwimage2.bin -p kernel:0x50000:0x180000:0x80060000:0x80060000:kernel
+fw_case mkporayfw mkporayfw.bin mkporayfw -B M4 -f kernel -o mkporayfw.bin
+fw_case mktplinkfw mktplinkfw.bin mktplinkfw -H 0x07500001 -W 1 -F 8Mlzma -N OpenWrt -V ver.1.0 -k small -r rootfs -o mktplinkfw.bin
+fw_case mktplinkfw2 mktplinkfw2.bin mktplinkfw2 -H 0x07500001 -W 1 -F 8MLmtk -N OpenWrt -V ver.1.0 -k small -r kernel -o mktplinkfw2.bin
+fw_case mkzcfw mkzcfw.bin mkzcfw -B ZCN-1523H-2-8 -k kernel -r small -o mkzcfw.bin
+fw_case mkbrnimg mkbrnimg.bin mkbrnimg -o mkbrnimg.bin kernel.lzma rootfs
+fw_case ptgen ptgen.bin ptgen -g -h 16 -s 63 -l 1024 -p 16M -p 32M -o ptgen.bin
+PREPARE='cp dg834 dgfirmware.in'
+fw_case dgfirmware dgfirmware.bin dgfirmware -f -w dgfirmware.bin dgfirmware.in
+
+# uImage wrappers
+PREPARE='cp uimage mkrtn56uimg.bin'
+fw_case mkrtn56uimg mkrtn56uimg.bin mkrtn56uimg -s mkrtn56uimg.bin
+PREPARE='cp uimage mkrtn56uimg-p.bin && '"$BIN"'/mkrtn56uimg -s mkrtn56uimg-p.bin'
+fw_case mkrtn56uimg-patch mkrtn56uimg-p.bin mkrtn56uimg -p mkrtn56uimg-p.bin -o 0x1000 -d small
+fw_case fix-u-media-header fix-u-media.bin fix-u-media-header -B 0x12345678 -i uimage -o fix-u-media.bin
+fw_case mkdapimg2 mkdapimg2.bin mkdapimg2 -s wapac26_dlink.2015_dap2610 -v 1.0 -r WW -k 0x200000 -i uimage -o mkdapimg2.bin
+fw_case mkheader_gemtek gemtek.bin mkheader_gemtek uimage gemtek.bin wrt100
+fw_case mkhilinkfw mkhilinkfw.bin mkhilinkfw -e -i uimage -o mkhilinkfw.bin
+fw_case uimage_padhdr uimage-pad.bin uimage_padhdr -i uimage -o uimage-pad.bin -l 1024
+fw_case uimage_sgehdr uimage-sge.bin uimage_sgehdr -i uimage -o uimage-sge.bin -m MODEL -h 1.0 -s 1.0
+
+# single blob headers, checksums and ciphers
+fw_case add_header add_header.bin add_header ar7100 kernel add_header.bin
+fw_case bcm4908kernel bcm4908kernel.bin bcm4908kernel -i kernel -o bcm4908kernel.bin
+fw_case buffalo-enc buffalo-enc.bin buffalo-enc -i kernel -o buffalo-enc.bin -p WZR-HP-AG300H -v 1.99 -m MAGIC
+fw_case buffalo-tag buffalo-tag.bin buffalo-tag -a ar71xx -b Buffalo -p WZR-HP-AG300H -r EU -l mlang20 -v 1.99 -w 3 -i kernel -o buffalo-tag.bin
+fw_case buffalo-tftp buffalo-tftp.bin buffalo-tftp -i kernel -o buffalo-tftp.bin
+fw_case cros-vbutil cros-vbutil.bin cros-vbutil -k kernel -c console=ttyS0 -o cros-vbutil.bin
+PREPARE='cp kernel dgn3500sum.bin'
+fw_case dgn3500sum dgn3500sum.bin dgn3500sum dgn3500sum.bin 0x10
+# the bundled keys don't load, so the signature is stack garbage; check the
+# round trip instead
+PREPARE='"$BIN"/dlink-sge-image DIR-882 kernel dlink-sge.bin > /dev/null'
+fw_case dlink-sge-image dlink-sge.out dlink-sge-image DIR-882 dlink-sge.bin dlink-sge.out -d
+fw_case dns313-header dns313.bin dns313-header kernel dns313.bin
+fw_case edimax_fw_header edimax_fw.bin edimax_fw_header -i kernel -o edimax_fw.bin -m BR-6104K -M CSYS -n kernel -s 0x20000 -e 0x200000 -t 1 -v 1.0
+fw_case hcsmakeimage hcsmakeimage.bin hcsmakeimage --input_file=kernel --output_file=hcsmakeimage.bin --magic_bytes=sa2100
+fw_case lzma2eva lzma2eva.bin lzma2eva 0x80000000 0x80000000 kernel lzma2eva.bin
+fw_case mkbrncmdline mkbrncmdline.bin mkbrncmdline -i kernel -o mkbrncmdline.bin -a 0x80000000 console=ttyS0
+fw_case mkbuffaloimg mkbuffaloimg.bin mkbuffaloimg -B WHR-G300N -i kernel -o mkbuffaloimg.bin -v 1.0 -r EU -R 0x300000 -K 0x180000
+fw_case mkdapimg mkdapimg.bin mkdapimg -m DAP-1350 -s RT3052-AP-DAP1350-3 -v 1.0 -r WW -i kernel -o mkdapimg.bin
+fw_case mkdhpimg mkdhpimg.bin mkdhpimg kernel mkdhpimg.bin
+fw_case mkdniimg mkdniimg.bin mkdniimg -B WNR3500L -i kernel -o mkdniimg.bin -v V1.0.0 -r WW
+fw_case mkedimaximg mkedimaximg.bin mkedimaximg -s CSYS -m RN68 -i kernel -o mkedimaximg.bin -f 0x70000 -S 0x80500000
+fw_case mkh3cimg mkh3cimg.bin mkh3cimg -p 0x3c010111 -d 0x30 -c none -i kernel -o mkh3cimg.bin
+fw_case mkh3cvfs mkh3cvfs.bin mkh3cvfs -f openwrt-kernel.bin -i kernel -o mkh3cvfs.bin
+fw_case mkmerakifw mkmerakifw.bin mkmerakifw -B mr18 -i kernel -o mkmerakifw.bin
+fw_case mkmerakifw-old mkmerakifw-old.bin mkmerakifw-old -B z1 -i kernel -o mkmerakifw-old.bin
+fw_case mkplanexfw mkplanexfw.bin mkplanexfw -B MZK-W04NU -i kernel -o mkplanexfw.bin -v 2.00
+fw_case mksenaofw mksenaofw.bin mksenaofw -e kernel -o mksenaofw.bin -t 2 -v 1.0 -r 0x101 -p 0x6 -m 0x12345678
+fw_case mkwrggimg mkwrggimg.bin mkwrggimg -i kernel -d /dev/mtdblock/2 -m DIR-615 -s wrgg03_0 -B 123 -v 1.0 -o mkwrggimg.bin
+fw_case mkwrgimg mkwrgimg.bin mkwrgimg -i kernel -d /dev/mtdblock/2 -s wrgn23_dlwbr_dir300b -o mkwrgimg.bin
+fw_case nand_ecc nand_ecc.bin nand_ecc kernel nand_ecc.bin
+fw_case nec-enc nec-enc.bin nec-enc -i kernel -o nec-enc.bin -k 0123456789abcdef
+fw_case pc1crypt pc1crypt.bin pc1crypt -i kernel -o pc1crypt.bin
+fw_case avm-wasp-checksum avm-wasp.bin avm-wasp-checksum -i kernel -o avm-wasp.bin -m 3390
+fw_case osbridge-crc osbridge.bin osbridge-crc -i kernel -o osbridge.bin
+PREPARE='cp kernel sign_dlink_ru.bin'
+fw_case sign_dlink_ru sign_dlink_ru.bin.new sign_dlink_ru sign_dlink_ru.bin 0123456789abcdef0123456789abcdef
+fw_case spw303v spw303v.bin spw303v -i kernel -o spw303v.bin
+fw_case srec2bin srec2bin.bin srec2bin small.srec srec2bin.bin
+fw_case xorimage xorimage.bin xorimage -i kernel -o xorimage.bin -p 12345678
+PREPARE='cp kernel zyimage.bin'
+fw_case zyimage zyimage.bin zyimage -v V1 -d 0x1234 zyimage.bin
+fw_case zyxbcm zyxbcm.bin zyxbcm -i kernel -o zyxbcm.bin
+PREPARE='cp kernel encode_crc.in'
+fw_case encode_crc encode_crc.bin encode_crc encode_crc.in encode_crc.bin
+PREPARE='cp kernel mksercommfw.bin'
+fw_case mksercommfw mksercommfw.bin mksercommfw -b 0x1 -r 1 -v 1 -i mksercommfw.bin
+
+if [ $UPDATE = 1 ]; then
+	cp hashes "$GOLDEN" || exit 1
+	echo "updated $GOLDEN"
+fi
+
+if [ $failed = 1 ]; then
+	echo "fw-regress: FAILED" >&2
+	exit 1
+fi
+
+echo "fw-regress: all cases passed"
@@ -125,7 +125,7 @@ void usage(void) __attribute__ (( __noreturn__ ));
 
 void usage(void)
 {
-	fprintf(stderr, "Usage: addpattern [-i trxfile] [-o binfile] [-B board_id] [-p pattern] [-s serial] [-g] [-b] [-v v#.#.#] [-r #.#] [-{0|1|2|4|5}] -h\n");
+	fprintf(stderr, "Usage: addpattern [-i trxfile] [-o binfile] [-B board_id] [-p pattern] [-s serial] [-g] [-b] [-v v#.#.#] [-r #.#] [-{0|1|2|4|5}] [-V board_id:binfile ...] -h\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -154,22 +154,49 @@ struct board_info *find_board(char *id)
 	return NULL;
 }
 
+#define MAX_OUTPUTS	32
+
+/* One output image, all of them share the data following the header */
+struct output {
+	char *ofn;
+	FILE *out;
+	char *pattern;
+	struct code_header hdr;
+};
+
+static void set_board(struct output *o, char *board_id)
+{
+	struct board_info *board = find_board(board_id);
+
+	if (board == NULL) {
+		fprintf(stderr, "unknown board \"%s\"\n", board_id);
+		usage();
+	}
+	o->pattern = board->pattern;
+	o->hdr.hw_ver = board->hw_ver;
+	o->hdr.sn = board->sn;
+	o->hdr.flags[0] = board->flags[0];
+	o->hdr.flags[1] = board->flags[1];
+}
+
 int main(int argc, char **argv)
 {
 	char buf[1024];	/* keep this at 1k or adjust garbage calc below */
 	struct code_header *hdr;
+	struct output outputs[MAX_OUTPUTS];
+	struct output *o;
+	char *variants[MAX_OUTPUTS];
+	int num_variants = 0, num_outputs = 0;
 	FILE *in = stdin;
-	FILE *out = stdout;
 	char *ifn = NULL;
 	char *ofn = NULL;
 	char *pattern = CODE_PATTERN;
 	char *pbotpat = PBOT_PATTERN;
 	char *version = CYBERTAN_VERSION;
 	char *board_id = NULL;
-	struct board_info *board = NULL;
 	int gflag = 0;
 	int pbotflag = 0;
-	int c;
+	int c, i;
 	int v0, v1, v2;
 	size_t off, n;
 	time_t t;
@@ -180,7 +207,7 @@ int main(int argc, char **argv)
 	hdr = (struct code_header *) buf;
 	memset(hdr, 0, sizeof(struct code_header));
 
-	while ((c = getopt(argc, argv, "i:o:p:s:gbv:01245hr:B:")) != -1) {
+	while ((c = getopt(argc, argv, "i:o:p:s:gbv:01245hr:B:V:")) != -1) {
 		switch (c) {
 			case 'i':
 				ifn = optarg;
@@ -235,6 +262,14 @@ int main(int argc, char **argv)
                         case 'B':
                                 board_id = optarg;
                                 break;
+			case 'V':
+				/* extra board variant sharing the same input */
+				if (num_variants == MAX_OUTPUTS - 1) {
+					fprintf(stderr, "too many variants\n");
+					usage();
+				}
+				variants[num_variants++] = optarg;
+				break;
 
                         case 'h':
 			default:
@@ -247,22 +282,37 @@ int main(int argc, char **argv)
 		usage();
 	}
 
-	if (board_id) {
-		board = find_board(board_id);
-		if (board == NULL) {
-			fprintf(stderr, "unknown board \"%s\"\n", board_id);
+	/* the plain output, stdout unless -o is given */
+	if (ofn || !num_variants) {
+		o = &outputs[num_outputs++];
+		o->ofn = ofn;
+		o->pattern = pattern;
+		o->hdr = *hdr;
+		if (board_id)
+			set_board(o, board_id);
+	}
+
+	/* -V board_id:binfile uses the common options with the board's header */
+	for (i = 0; i < num_variants; i++) {
+		char *sep = strchr(variants[i], ':');
+
+		if (!sep || !sep[1]) {
+			fprintf(stderr, "illegal variant \"%s\"\n", variants[i]);
 			usage();
 		}
-		pattern = board->pattern;
-		hdr->hw_ver = board->hw_ver;
-		hdr->sn = board->sn;
-		hdr->flags[0] = board->flags[0];
-		hdr->flags[1] = board->flags[1];
+		*sep = '\0';
+
+		o = &outputs[num_outputs++];
+		o->ofn = sep + 1;
+		o->hdr = *hdr;
+		set_board(o, variants[i]);
 	}
 
-	if (strlen(pattern) > 8) {
-		fprintf(stderr, "illegal pattern \"%s\"\n", pattern);
-		usage();
+	for (i = 0, o = outputs; i < num_outputs; i++, o++) {
+		if (strlen(o->pattern) > 8) {
+			fprintf(stderr, "illegal pattern \"%s\"\n", o->pattern);
+			usage();
+		}
 	}
 
 	if (ifn && !(in = fopen(ifn, "r"))) {
@@ -270,9 +320,12 @@ int main(int argc, char **argv)
 		usage();
 	}
 
-	if (ofn && !(out = fopen(ofn, "w"))) {
-		fprintf(stderr, "can not open \"%s\" for writing\n", ofn);
-		usage();
+	for (i = 0, o = outputs; i < num_outputs; i++, o++) {
+		o->out = stdout;
+		if (o->ofn && !(o->out = fopen(o->ofn, "w"))) {
+			fprintf(stderr, "can not open \"%s\" for writing\n", o->ofn);
+			usage();
+		}
 	}
 
 	set_source_date_epoch();
@@ -290,26 +343,28 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	memcpy(hdr->magic, pattern, strlen(pattern));
-	if (pbotflag)
-		memcpy(&hdr->magic[4], pbotpat, 4);
-	hdr->fwdate[0] = ptm->tm_year % 100;
-	hdr->fwdate[1] = ptm->tm_mon + 1;
-	hdr->fwdate[2] = ptm->tm_mday;
-	hdr->fwvern[0] = v0;
-	hdr->fwvern[1] = v1;
-	hdr->fwvern[2] = v2;
-	memcpy(hdr->id, CODE_ID, strlen(CODE_ID));
+	for (i = 0, o = outputs; i < num_outputs; i++, o++) {
+		memcpy(o->hdr.magic, o->pattern, strlen(o->pattern));
+		if (pbotflag)
+			memcpy(&o->hdr.magic[4], pbotpat, 4);
+		o->hdr.fwdate[0] = ptm->tm_year % 100;
+		o->hdr.fwdate[1] = ptm->tm_mon + 1;
+		o->hdr.fwdate[2] = ptm->tm_mday;
+		o->hdr.fwvern[0] = v0;
+		o->hdr.fwvern[1] = v1;
+		o->hdr.fwvern[2] = v2;
+		memcpy(o->hdr.id, CODE_ID, strlen(CODE_ID));
+	}
 
 	off = sizeof(struct code_header);
 
 	fprintf(stderr, "writing firmware v%d.%d.%d on %d/%d/%d (y/m/d)\n",
 			v0, v1, v2,
-			hdr->fwdate[0], hdr->fwdate[1], hdr->fwdate[2]);
+			outputs[0].hdr.fwdate[0], outputs[0].hdr.fwdate[1], outputs[0].hdr.fwdate[2]);
 
 
+	/* the first block carries each output's own header */
 	while ((n = fread(buf + off, 1, sizeof(buf)-off, in) + off) > 0) {
-		off = 0;
 		if (n < sizeof(buf)) {
 			if (ferror(in)) {
 			FREAD_ERROR:
@@ -323,23 +378,30 @@ int main(int argc, char **argv)
 				n = sizeof(buf);
 			}
 		}
-		if (!fwrite(buf, n, 1, out)) {
-		FWRITE_ERROR:
-			fprintf(stderr, "fwrite error\n");
-			return EXIT_FAILURE;
+		for (i = 0, o = outputs; i < num_outputs; i++, o++) {
+			if (off)
+				memcpy(buf, &o->hdr, off);
+			if (!fwrite(buf, n, 1, o->out)) {
+			FWRITE_ERROR:
+				fprintf(stderr, "fwrite error\n");
+				return EXIT_FAILURE;
+			}
 		}
+		off = 0;
 	}
 
 	if (ferror(in)) {
 		goto FREAD_ERROR;
 	}
 
-	if (fflush(out)) {
-		goto FWRITE_ERROR;
+	for (i = 0, o = outputs; i < num_outputs; i++, o++) {
+		if (fflush(o->out)) {
+			goto FWRITE_ERROR;
+		}
+		fclose(o->out);
 	}
 
 	fclose(in);
-	fclose(out);
 
 	return EXIT_SUCCESS;
 }
@@ -12,6 +12,7 @@
 #include <stdarg.h>
 
 #include "buffalo-lib.h"
+#include "fwmap.h"
 
 #define ERR(fmt, args...) do { \
 	fflush(0); \
@@ -60,29 +61,21 @@ void usage(int status)
 static int decrypt_file(void)
 {
 	struct enc_param ep;
+	struct fw_map map;
 	ssize_t src_len;
-	unsigned char *buf = NULL;
+	unsigned char *buf;
 	int err;
 	int ret = -1;
 
-	src_len = get_file_size(ifname);
-	if (src_len < 0) {
-		ERR("unable to get size of '%s'", ifname);
-		goto out;
-	}
-
-	buf = malloc(src_len);
-	if (buf == NULL) {
-		ERR("no memory for the buffer");
-		goto out;
-	}
-
-	err = read_file_to_buf(ifname, buf, src_len);
+	err = fw_map_file(&map, ifname, FW_MAP_WRITE);
 	if (err) {
 		ERR("unable to read from file '%s'", ifname);
 		goto out;
 	}
 
+	buf = map.data;
+	src_len = map.size;
+
 	memset(&ep, '\0', sizeof(ep));
 	ep.key = (unsigned char *) crypt_key;
 	ep.longstate = longstate;
@@ -90,7 +83,7 @@ static int decrypt_file(void)
 	err = decrypt_buf(&ep, buf + offset, src_len - offset);
 	if (err) {
 		ERR("unable to decrypt '%s'", ifname);
-		goto out;
+		goto unmap;
 	}
 
 	printf("Magic\t\t: '%s'\n", ep.magic);
@@ -103,13 +96,14 @@ static int decrypt_file(void)
 	err = write_buf_to_file(ofname, buf + offset, ep.datalen);
 	if (err) {
 		ERR("unable to write to file '%s'", ofname);
-		goto out;
+		goto unmap;
 	}
 
 	ret = 0;
 
+unmap:
+	fw_unmap_file(&map);
 out:
-	free(buf);
 	return ret;
 }
 
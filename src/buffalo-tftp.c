@@ -12,6 +12,7 @@
 #include <stdarg.h>
 
 #include "buffalo-lib.h"
+#include "fwmap.h"
 
 #define ERR(fmt, args...) do { \
 	fflush(0); \
@@ -64,29 +65,21 @@ static void crypt_header(unsigned char *buf, ssize_t len,
 
 static int crypt_file(void)
 {
-	unsigned char *buf = NULL;
+	struct fw_map map;
+	unsigned char *buf;
 	ssize_t src_len;
 	int err;
 	int ret = -1;
 
-	src_len = get_file_size(ifname);
-	if (src_len < 0) {
-		ERR("unable to get size of '%s'", ifname);
-		goto out;
-	}
-
-	buf = malloc(src_len);
-	if (buf == NULL) {
-		ERR("no memory for the buffer");
-		goto out;
-	}
-
-	err = read_file_to_buf(ifname, buf, src_len);
+	err = fw_map_file(&map, ifname, FW_MAP_WRITE);
 	if (err) {
 		ERR("unable to read from file '%s'", ifname);
 		goto out;
 	}
 
+	buf = map.data;
+	src_len = map.size;
+
 	if (do_decrypt)
 		crypt_header(buf, 512, crypt_key2, crypt_key1);
 	else
@@ -95,13 +88,14 @@ static int crypt_file(void)
 	err = write_buf_to_file(ofname, buf, src_len);
 	if (err) {
 		ERR("unable to write to file '%s'", ofname);
-		goto out;
+		goto unmap;
 	}
 
 	ret = 0;
 
+unmap:
+	fw_unmap_file(&map);
 out:
-	free(buf);
 	return ret;
 }
 
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * POSIX cksum style CRC-32
+ *
+ * The data is processed eight bytes at a time using slice-by-8 tables for
+ * the non-reflected polynomial; the tables are constant data generated by
+ * crc32.c (see cksum_table.h).
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "cksum.h"
+#include "cksum_table.h"
+#include "fwstats.h"
+
+#define CKSUM_BUFLEN	(1 << 20)
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+	       ((uint32_t) p[2] << 8) | p[3];
+}
+
+uint32_t cksum_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t bytes = len;
+	struct fwstats_timer t;
+
+	fwstats_start(&t, FWSTATS_CSUM);
+
+	while (len >= 8) {
+		uint32_t a = crc ^ get_be32(p);
+		uint32_t b = get_be32(p + 4);
+
+		crc = cksum_table[7][a >> 24] ^
+		      cksum_table[6][(a >> 16) & 0xff] ^
+		      cksum_table[5][(a >> 8) & 0xff] ^
+		      cksum_table[4][a & 0xff] ^
+		      cksum_table[3][b >> 24] ^
+		      cksum_table[2][(b >> 16) & 0xff] ^
+		      cksum_table[1][(b >> 8) & 0xff] ^
+		      cksum_table[0][b & 0xff];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = (crc << 8) ^ cksum_table[0][(crc >> 24) ^ *p++];
+
+	fwstats_stop(&t, bytes);
+	return crc;
+}
+
+uint32_t cksum_final(uint32_t crc, uint64_t len)
+{
+	for (; len; len >>= 8)
+		crc = (crc << 8) ^ cksum_table[0][((crc >> 24) ^ len) & 0xff];
+
+	return ~crc;
+}
+
+uint32_t cksum_buf(const void *buf, size_t len)
+{
+	return cksum_final(cksum_update(0, buf, len), len);
+}
+
+int cksum_fd(int fd, uint64_t len, uint32_t *res)
+{
+	uint32_t crc = 0;
+	uint64_t done = 0;
+	uint8_t *buf;
+
+	if (len == 0) {
+		*res = cksum_final(0, 0);
+		return 0;
+	}
+
+	buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf != MAP_FAILED) {
+		madvise(buf, len, MADV_SEQUENTIAL);
+		*res = cksum_buf(buf, len);
+		munmap(buf, len);
+		return 0;
+	}
+
+	/* not mappable (pipe, odd file system, ...), stream it instead */
+	buf = malloc(CKSUM_BUFLEN);
+	if (!buf)
+		return -ENOMEM;
+	fwstats_alloc(CKSUM_BUFLEN);
+
+	while (done < len) {
+		size_t want = len - done < CKSUM_BUFLEN ? len - done : CKSUM_BUFLEN;
+		struct fwstats_timer t;
+		ssize_t n;
+
+		fwstats_start(&t, FWSTATS_READ);
+		n = pread(fd, buf, want, done);
+		fwstats_stop(&t, n > 0 ? n : 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			free(buf);
+			return n ? -errno : -EIO;
+		}
+		crc = cksum_update(crc, buf, n);
+		done += n;
+	}
+
+	free(buf);
+	*res = cksum_final(crc, len);
+	return 0;
+}
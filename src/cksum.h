@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * POSIX cksum style CRC-32
+ *
+ * MSB-first (non-reflected) CRC-32 with polynomial 0x04C11DB7 and a zero
+ * initial value.  The final value is obtained by feeding the message
+ * length, least significant byte first and without trailing zero bytes,
+ * and inverting the result, exactly like cksum(1).
+ */
+
+#ifndef cksum_h
+#define cksum_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* raw CRC update, no length trailer and no inversion */
+uint32_t cksum_update(uint32_t crc, const void *buf, size_t len);
+
+/* append the length trailer of a len bytes long message and invert */
+uint32_t cksum_final(uint32_t crc, uint64_t len);
+
+/* cksum of a whole buffer */
+uint32_t cksum_buf(const void *buf, size_t len);
+
+/* cksum of the first len bytes of fd, mapped or streamed from offset 0 */
+int cksum_fd(int fd, uint64_t len, uint32_t *res);
+
+#endif				/* cksum_h */
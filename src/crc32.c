@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Reflected CRC-32 (IEEE 802.3, polynomial 0xEDB88320) helpers
+ *
+ * Data is processed eight bytes at a time using slice-by-8 tables.  Zero
+ * extension multiplies the register by x^(8 * len) modulo the polynomial
+ * using a table of x^(2^n), the same approach zlib uses for
+ * crc32_combine().  Both tables are constant data kept in crc32_table.h,
+ * so no tool pays for building them at startup.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "fwstats.h"
+
+#define CRC32_POLY	0xedb88320
+
+/* a * b modulo the CRC polynomial, both in reflected representation */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31;
+	uint32_t p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+
+	return p;
+}
+
+#ifdef CRC32_GENTAB
+
+/*
+ * Table generator: the tables in crc32_table.h and cksum_table.h are
+ * constant data, so every tool gets them from .rodata instead of building
+ * them at startup.  Regenerate with
+ *
+ *   cc -DCRC32_GENTAB -o crc32-gentab src/crc32.c
+ *   ./crc32-gentab > src/crc32_table.h
+ *   ./crc32-gentab cksum > src/cksum_table.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX cksum: same polynomial, but MSB first and not reflected */
+#define CKSUM_POLY	0x04c11db7
+
+static void crc32_print(const uint32_t *t, int n, const char *indent)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		printf("%s0x%08x%s", i % 6 ? " " : indent, t[i],
+		       i == n - 1 ? "\n" : (i % 6 == 5 ? ",\n" : ","));
+}
+
+static void cksum_gentab(void)
+{
+	uint32_t table[8][256];
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		c = (uint32_t) i << 24;
+		for (j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CKSUM_POLY : (c << 1);
+		table[0][i] = c;
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = table[0][i];
+		for (j = 1; j < 8; j++) {
+			c = (c << 8) ^ table[0][c >> 24];
+			table[j][i] = c;
+		}
+	}
+
+	printf("/* SPDX-License-Identifier: GPL-2.0-or-later */\n"
+	       "/* Generated by crc32.c with -DCRC32_GENTAB, do not edit */\n\n"
+	       "static const uint32_t cksum_table[8][256]\n"
+	       "\t__attribute__((aligned(64))) = {\n");
+	for (i = 0; i < 8; i++) {
+		printf("\t{\n");
+		crc32_print(table[i], 256, "\t\t");
+		printf(i == 7 ? "\t}\n" : "\t},\n");
+	}
+	printf("};\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t table[8][256], x2n[32];
+	uint32_t c;
+	int i, j;
+
+	if (argc > 1 && !strcmp(argv[1], "cksum")) {
+		cksum_gentab();
+		return 0;
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : (c >> 1);
+		table[0][i] = c;
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = table[0][i];
+		for (j = 1; j < 8; j++) {
+			c = (c >> 8) ^ table[0][c & 0xff];
+			table[j][i] = c;
+		}
+	}
+
+	/* x^1, x^2, x^4, ... in reflected representation */
+	c = 1U << 30;
+	x2n[0] = c;
+	for (i = 1; i < 32; i++)
+		x2n[i] = c = crc32_multmodp(c, c);
+
+	printf("/* SPDX-License-Identifier: GPL-2.0-or-later */\n"
+	       "/* Generated by crc32.c with -DCRC32_GENTAB, do not edit */\n\n"
+	       "static const uint32_t crc32_table[8][256]\n"
+	       "\t__attribute__((aligned(64))) = {\n");
+	for (i = 0; i < 8; i++) {
+		printf("\t{\n");
+		crc32_print(table[i], 256, "\t\t");
+		printf(i == 7 ? "\t}\n" : "\t},\n");
+	}
+	printf("};\n\n"
+	       "static const uint32_t crc32_x2n_table[32] = {\n");
+	crc32_print(x2n, 32, "\t");
+	printf("};\n");
+
+	return 0;
+}
+
+#else				/* CRC32_GENTAB */
+
+#include "crc32_table.h"
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
+	       ((uint32_t) p[3] << 24);
+}
+
+uint32_t crc32_le_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t bytes = len;
+	struct fwstats_timer t;
+
+	fwstats_start(&t, FWSTATS_CSUM);
+
+	while (len >= 8) {
+		uint32_t a = crc ^ get_le32(p);
+		uint32_t b = get_le32(p + 4);
+
+		crc = crc32_table[7][a & 0xff] ^
+		      crc32_table[6][(a >> 8) & 0xff] ^
+		      crc32_table[5][(a >> 16) & 0xff] ^
+		      crc32_table[4][a >> 24] ^
+		      crc32_table[3][b & 0xff] ^
+		      crc32_table[2][(b >> 8) & 0xff] ^
+		      crc32_table[1][(b >> 16) & 0xff] ^
+		      crc32_table[0][b >> 24];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+
+	fwstats_stop(&t, bytes);
+	return crc;
+}
+
+uint32_t crc32_le_shift(uint32_t crc, uint64_t len)
+{
+	uint32_t p = 1U << 31;	/* x^0 */
+	int k = 3;		/* x^(8 * len) == x^(2^3 * len) */
+
+	if (!len || !crc)
+		return crc;
+
+	for (; len; len >>= 1, k++)
+		if (len & 1)
+			p = crc32_multmodp(crc32_x2n_table[k & 31], p);
+
+	return crc32_multmodp(p, crc);
+}
+
+uint32_t crc32_le_patch(uint32_t crc, uint64_t total_len, uint64_t offset,
+			const void *old_bytes, const void *new_bytes, size_t len)
+{
+	const uint8_t *o = old_bytes;
+	const uint8_t *n = new_bytes;
+	uint32_t delta = 0;
+	uint8_t buf[256];
+	size_t i, chunk;
+
+	for (; len; len -= chunk, o += chunk, n += chunk) {
+		chunk = len < sizeof(buf) ? len : sizeof(buf);
+		for (i = 0; i < chunk; i++)
+			buf[i] = o[i] ^ n[i];
+		delta = crc32_le_update(delta, buf, chunk);
+		offset += chunk;
+	}
+
+	return crc ^ crc32_le_shift(delta, total_len - offset);
+}
+
+#endif				/* CRC32_GENTAB */
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Reflected CRC-32 (IEEE 802.3, polynomial 0xEDB88320) helpers
+ *
+ * All functions work on the raw CRC register: no initial value is applied
+ * and the result is not inverted, so they fit both the zlib style CRC
+ * (start with ~0, invert at the end) and vendor variants that skip one or
+ * both of those steps.  Because the CRC is linear, checksums of adjacent
+ * pieces can be combined without touching the data again.
+ */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* feed len bytes of buf into the CRC register */
+uint32_t crc32_le_update(uint32_t crc, const void *buf, size_t len);
+
+/* advance the CRC register over len zero bytes in O(log len) */
+uint32_t crc32_le_shift(uint32_t crc, uint64_t len);
+
+/*
+ * CRC of a total_len byte message after the len bytes at offset changed
+ * from old_bytes to new_bytes, given its CRC before the change.  Only the
+ * patched bytes are read; the initial value and final inversion cancel
+ * out, so crc may be taken either raw or inverted.
+ */
+uint32_t crc32_le_patch(uint32_t crc, uint64_t total_len, uint64_t offset,
+			const void *old_bytes, const void *new_bytes, size_t len);
+
+/*
+ * CRC of A followed by B, where crc1 is the CRC of A (from any initial
+ * value) and crc2 is the CRC of the len2 bytes of B started from 0.
+ */
+static inline uint32_t crc32_le_combine(uint32_t crc1, uint32_t crc2,
+					uint64_t len2)
+{
+	return crc32_le_shift(crc1, len2) ^ crc2;
+}
+
+#endif				/* _CRC32_H */
@@ -43,16 +43,21 @@
  * by the Free Software Foundation.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <openssl/x509.h>
 #include <openssl/sha.h>
 
+#include "fwmap.h"
+
 #define BLOCK_PAD 65536
 /* Sections are aligned to 4K blocks */
 #define ALIGN 4096
@@ -347,57 +352,144 @@ struct vb2_kernel_preamble {
 	uint32_t flags;
 } __attribute__((packed));
 
-/*
- * Order matters. |data| may overlap with |siginfo|, so we need to fill out
- * |siginfo| before computing the signature.
- */
-static int sign(const void *data, size_t len, struct vb2_signature *siginfo,
-		void *sigout)
+/* The signing key, parsed once and shared by every signature we emit */
+struct vb_signer {
+	EVP_PKEY *key;
+};
+
+static int signer_init(struct vb_signer *signer)
 {
-	unsigned char hash[SHA256_DIGEST_LENGTH];
-	SHA256_CTX sha256;
-	int ret;
+	const unsigned char *p = privk;
+
+	signer->key = d2i_PrivateKey(EVP_PKEY_RSA, NULL, &p, privk_len);
+	if (!signer->key) {
+		fprintf(stderr, "Failed d2i_PrivateKey()\n");
+		return -1;
+	}
+
+	return 0;
+}
 
+static void signer_free(struct vb_signer *signer)
+{
+	EVP_PKEY_free(signer->key);
+	signer->key = NULL;
+}
+
+static void fill_siginfo(struct vb2_signature *siginfo, size_t len,
+			 void *sigout)
+{
 	memset(siginfo, 0, sizeof(*siginfo));
 	siginfo->sig_offset = (uintptr_t)(void *)sigout - (uintptr_t)(void *)siginfo;
 	siginfo->sig_size = SIG_SIZE;
 	siginfo->data_size = len;
+}
 
-	const unsigned char *p = privk;
-	char digest_info[] = {
-		0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
-		0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20,
-	};
+/* PKCS#1 v1.5 signature of a SHA-256 hash, the DigestInfo is added by EVP */
+static int sign_hash(const struct vb_signer *signer,
+		     const unsigned char hash[SHA256_DIGEST_LENGTH], void *sigout)
+{
+	size_t siglen = SIG_SIZE;
+	EVP_PKEY_CTX *ctx;
+	int ret = -1;
 
-	uint8_t digest[sizeof(digest_info) + sizeof(hash)];
+	ctx = EVP_PKEY_CTX_new(signer->key, NULL);
+	if (!ctx) {
+		fprintf(stderr, "%s: EVP_PKEY_CTX_new() failed\n", __func__);
+		return -1;
+	}
+
+	if (EVP_PKEY_sign_init(ctx) <= 0 ||
+	    EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0 ||
+	    EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) <= 0 ||
+	    EVP_PKEY_sign(ctx, sigout, &siglen, hash, SHA256_DIGEST_LENGTH) <= 0 ||
+	    siglen != SIG_SIZE)
+		fprintf(stderr, "%s: EVP_PKEY_sign() failed\n", __func__);
+	else
+		ret = 0;
+
+	EVP_PKEY_CTX_free(ctx);
 
-	SHA256_Init(&sha256);
-	SHA256_Update(&sha256, data, len);
-	SHA256_Final(hash, &sha256);
+	return ret;
+}
+
+/*
+ * Order matters. |data| may overlap with |siginfo|, so we need to fill out
+ * |siginfo| before computing the signature.
+ */
+static int sign(const struct vb_signer *signer, const void *data, size_t len,
+		struct vb2_signature *siginfo, void *sigout)
+{
+	unsigned char hash[SHA256_DIGEST_LENGTH];
 
-	memcpy(digest, digest_info, sizeof(digest_info));
-	memcpy(digest + sizeof(digest_info), hash, sizeof(hash));
+	fill_siginfo(siginfo, len, sigout);
 
-	RSA *key = d2i_RSAPrivateKey(0, &p, privk_len);
-	if (!key) {
-		fprintf(stderr, "Failed d2i_RSAPrivateKey()\n");
+	if (!EVP_Digest(data, len, hash, NULL, EVP_sha256(), NULL)) {
+		fprintf(stderr, "%s: EVP_Digest() failed\n", __func__);
 		return -1;
 	}
 
-	ret = RSA_private_encrypt(sizeof(digest), digest, sigout, key,
-				  RSA_PKCS1_PADDING);
-	if (ret == -1) {
-		fprintf(stderr, "%s: RSA_private_encrypt() failed\n", __func__);
-		return -1;
+	return sign_hash(signer, hash, sigout);
+}
+
+static const unsigned char zero_pad[ALIGN];
+
+/*
+ * The kernel blob is the kernel and the command line, each zero padded to
+ * ALIGN, followed by empty "parameters" and "bootloader" pages.  It is
+ * never materialised: it is hashed and written straight from the input.
+ */
+struct kblob {
+	const void *kernel;
+	size_t kernel_len;
+	const char *config;
+	size_t config_len;
+};
+
+static size_t kblob_len(const struct kblob *kb)
+{
+	return ROUNDUP(kb->kernel_len) + ROUNDUP(kb->config_len) + ALIGN + ALIGN;
+}
+
+static int sha256_update_zero(EVP_MD_CTX *sha256, size_t len)
+{
+	while (len) {
+		size_t n = len < sizeof(zero_pad) ? len : sizeof(zero_pad);
+
+		if (!EVP_DigestUpdate(sha256, zero_pad, n))
+			return 0;
+		len -= n;
 	}
 
-	return 0;
+	return 1;
+}
+
+static int kblob_hash(const struct kblob *kb,
+		      unsigned char hash[SHA256_DIGEST_LENGTH])
+{
+	EVP_MD_CTX *sha256;
+	int ok;
+
+	sha256 = EVP_MD_CTX_new();
+	if (!sha256)
+		return -1;
+
+	ok = EVP_DigestInit_ex(sha256, EVP_sha256(), NULL) &&
+	     EVP_DigestUpdate(sha256, kb->kernel, kb->kernel_len) &&
+	     sha256_update_zero(sha256, ROUNDUP(kb->kernel_len) - kb->kernel_len) &&
+	     EVP_DigestUpdate(sha256, kb->config, kb->config_len) &&
+	     sha256_update_zero(sha256, ROUNDUP(kb->config_len) - kb->config_len +
+					ALIGN + ALIGN) &&
+	     EVP_DigestFinal_ex(sha256, hash, NULL);
+	EVP_MD_CTX_free(sha256);
+
+	return ok ? 0 : -1;
 }
 
 static struct vb2_kernel_preamble *
-generate_preamble(const void *kblob, size_t kblob_len,
-		  size_t kernel_len, size_t config_len)
+generate_preamble(const struct vb_signer *signer, const struct kblob *kb)
 {
+	unsigned char hash[SHA256_DIGEST_LENGTH];
 	struct vb2_kernel_preamble *h;
 	uint32_t signed_size = sizeof(struct vb2_kernel_preamble) + SIG_SIZE;
 	uint32_t block_size = signed_size + SIG_SIZE;
@@ -412,9 +504,16 @@ generate_preamble(const void *kblob, size_t kblob_len,
 	}
 
 	/* Sign the body, place the signature in the preamble */
-	ret = sign(kblob, kblob_len, &h->body_signature, h + 1);
+	if (kblob_hash(kb, hash)) {
+		fprintf(stderr, "Failed to hash the kernel blob\n");
+		free(h);
+		return NULL;
+	}
+	fill_siginfo(&h->body_signature, kblob_len(kb), h + 1);
+	ret = sign_hash(signer, hash, h + 1);
 	if (ret) {
 		fprintf(stderr, "sign() failed: %d\n", ret);
+		free(h);
 		return NULL;
 	}
 
@@ -428,144 +527,182 @@ generate_preamble(const void *kblob, size_t kblob_len,
 	 * parameter page.
 	 */
 	h->bootloader_address = h->body_load_address +
-				ROUNDUP(kernel_len) +
-				ROUNDUP(config_len) +
+				ROUNDUP(kb->kernel_len) +
+				ROUNDUP(kb->config_len) +
 				ALIGN;
 	h->bootloader_size = 0x1000;
 	h->vmlinuz_header_address = 0;
 	h->vmlinuz_header_size = 0;
 	h->flags = 0;
 
-	ret = sign(h, signed_size, &h->preamble_signature,
+	ret = sign(signer, h, signed_size, &h->preamble_signature,
 		   (void *)(h + 1) + SIG_SIZE);
 	if (ret) {
 		fprintf(stderr, "failed to sign preamble: %d\n", ret);
+		free(h);
 		return NULL;
 	}
 	return h;
 }
 
+#define MAX_IOV 8
+
+static int iov_add_zero(struct iovec *iov, int n, size_t len)
+{
+	while (len) {
+		size_t chunk = len < sizeof(zero_pad) ? len : sizeof(zero_pad);
+
+		iov[n].iov_base = (void *)zero_pad;
+		iov[n].iov_len = chunk;
+		n++;
+		len -= chunk;
+	}
+
+	return n;
+}
+
+static int writev_all(int fd, struct iovec *iov, int cnt)
+{
+	while (cnt) {
+		ssize_t ret = writev(fd, iov, cnt);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("writev");
+			return -1;
+		}
+
+		while (cnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
 
 /*
  * Distilled from vboot_reference futility/cmd_vbutil_kernel.c pack command.
  *
  * NB: "config" is the kernel cmdline
  */
-static int vbutil_pack(const char *kernel, size_t kernel_len,
+static int vbutil_pack(const struct vb_signer *signer,
+		       const void *kernel, size_t kernel_len,
 		       const char *config, size_t config_len,
-		       void **out, size_t *out_len)
+		       int fd)
 {
-	size_t kblob_len = ROUNDUP(kernel_len) + ROUNDUP(config_len) + ALIGN + ALIGN;
-	void *kblob = malloc(kblob_len);
-	if (!kblob) {
-		perror("malloc");
-		return -1;
-	}
-	void *kp = kblob;
-	memset(kblob, 0, kblob_len);
-
-	/* Kernel */
-	memcpy(kp, kernel, kernel_len);
-	kp += ROUNDUP(kernel_len);
-
-	/* Kernel command line */
-	memcpy(kp, config, config_len);
-	kp += ROUNDUP(config_len);
+	struct kblob kb = {
+		.kernel = kernel,
+		.kernel_len = kernel_len,
+		.config = config,
+		.config_len = config_len,
+	};
+	struct iovec iov[MAX_IOV];
+	int n = 0;
+	int ret;
 
 	/* "Parameters" -- empty, 4K-aligned */
 	/* "Bootloader" region -- empty, 4K-aligned */
 	/* Vmlinuz header -- only for x86 (not currently supported), empty */
 
 	struct vb2_kernel_preamble *h;
-	h = generate_preamble(kblob, kblob_len, kernel_len, config_len);
+	h = generate_preamble(signer, &kb);
 	if (!h) {
 		fprintf(stderr, "Failed to generate preamble\n");
 		return -1;
 	}
-	size_t outlen = sizeof(keyblock) + h->preamble_size + kblob_len;
-	void *outbuf = malloc(outlen);
-	if (!outbuf)
-		return -1;
 
-	void *p = outbuf;
-	memcpy(p, keyblock, sizeof(keyblock));
-	p += sizeof(keyblock);
+	iov[n].iov_base = (void *)keyblock;
+	iov[n++].iov_len = sizeof(keyblock);
 
-	memcpy(p, h, h->preamble_size);
-	p += h->preamble_size;
+	iov[n].iov_base = h;
+	iov[n++].iov_len = h->preamble_size;
 
-	memcpy(p, kblob, kblob_len);
-	p += kblob_len;
+	/* Kernel */
+	iov[n].iov_base = (void *)kernel;
+	iov[n++].iov_len = kernel_len;
+	n = iov_add_zero(iov, n, ROUNDUP(kernel_len) - kernel_len);
 
-	if (outbuf) {
-		*out = outbuf;
-		*out_len = outlen;
-	}
+	/* Kernel command line, parameters and bootloader pages */
+	iov[n].iov_base = (void *)config;
+	iov[n++].iov_len = config_len;
+	n = iov_add_zero(iov, n, ROUNDUP(config_len) - config_len + ALIGN + ALIGN);
 
-	return 0;
+	ret = writev_all(fd, iov, n);
+	free(h);
+
+	return ret;
 }
 
-static void * read_file(const char *path, size_t *out_len)
+static int sign_kernel(const struct vb_signer *signer, const char *kernel_file,
+		       const char *cmdline, size_t cmdline_len,
+		       const char *out_file)
 {
-	struct stat st;
-	int fd = open(path, O_RDONLY);
-	if (fd == -1) {
-		perror("failed to open");
-		return NULL;
-	}
+	struct fw_map kernel;
+	int ret;
 
-	if (fstat(fd, &st) < 0) {
-		perror("fstat");
-		return NULL;
+	if (fw_map_file(&kernel, kernel_file, 0)) {
+		fprintf(stderr, "failed to read kernel file: %s: %s\n",
+			kernel_file, strerror(errno));
+		return -1;
 	}
 
-	size_t len = st.st_size;
-	void *p = malloc(len);
-	if (!p)
-		return NULL;
-
-	size_t count = 0;
-	while (count < len) {
-		ssize_t ret = read(fd, p + count, len - count);
-		if (ret < 0) {
-			perror("read");
-			return NULL;
-		}
-		count += ret;
+	int fd = open(out_file, O_RDWR|O_CREAT, 0644);
+	if (fd == -1) {
+		perror("open");
+		fw_unmap_file(&kernel);
+		return -1;
 	}
 
+	ret = vbutil_pack(signer, kernel.data, kernel.size, cmdline, cmdline_len, fd);
 	close(fd);
+	fw_unmap_file(&kernel);
 
-	*out_len = len;
-	return p;
+	return ret;
 }
 
 int main(int argc, char * const argv[])
 {
-	int ret;
-	const char *kernel_file = NULL;
-	const char *out_file = NULL;
+	int ret = 0;
+	const char **kernel_files;
+	const char **out_files;
+	int nkernels = 0, nouts = 0;
 	const char *cmdline = NULL;
 	size_t cmdline_len;
-	void *kernel;
-	size_t kernel_len;
-	void *out;
-	size_t out_len;
+	struct vb_signer signer;
+	int i;
+
+	kernel_files = calloc(argc, sizeof(*kernel_files));
+	out_files = calloc(argc, sizeof(*out_files));
+	if (!kernel_files || !out_files) {
+		perror("calloc");
+		return -1;
+	}
 
+	/*
+	 * -k and -o may be repeated to sign several kernels with the same
+	 * command line in one go; they are paired in the order given.
+	 */
 	int opt;
 	while ((opt = getopt(argc, argv, "k:c:o:")) != -1) {
 		switch (opt) {
 		case 'k':
-			kernel_file = optarg;
+			kernel_files[nkernels++] = optarg;
 			break;
 		case 'c':
 			cmdline = optarg;
 			break;
 		case 'o':
-			out_file = optarg;
+			out_files[nouts++] = optarg;
 			break;
 		default:
-			fprintf(stderr, "Usage [-k <kernel>] [-c <command line>] -o <outfile>\n");
+			fprintf(stderr, "Usage [-k <kernel>] [-c <command line>] -o <outfile> [-k <kernel> -o <outfile>]...\n");
 			return -1;
 		}
 	}
@@ -573,36 +710,28 @@ int main(int argc, char * const argv[])
 		fprintf(stderr, "Unexpected args?\n");
 		return -1;
 	}
-	if (!out_file || !cmdline || !kernel_file) {
+	if (!nouts || !cmdline || !nkernels) {
 		fprintf(stderr, "Missing required argument\n");
 		return -1;
 	}
+	if (nouts != nkernels) {
+		fprintf(stderr, "Each kernel needs exactly one output file\n");
+		return -1;
+	}
 
 	/* Include the \0 terminator */
 	cmdline_len = strlen(cmdline) + 1;
 
-	kernel = read_file(kernel_file, &kernel_len);
-	if (!kernel) {
-		fprintf(stderr, "failed to read kernel file: %s\n", kernel_file);
+	if (signer_init(&signer))
 		return -1;
-	}
 
-	ret = vbutil_pack(kernel, kernel_len, cmdline, cmdline_len, &out, &out_len);
-	if (ret)
-		return ret;
+	for (i = 0; i < nkernels && !ret; i++)
+		ret = sign_kernel(&signer, kernel_files[i], cmdline, cmdline_len,
+				  out_files[i]);
 
-	int fd = open(out_file, O_RDWR|O_CREAT, 0644);
-	if (fd == -1) {
-		perror("open");
-		return -1;
-	}
+	signer_free(&signer);
+	free(kernel_files);
+	free(out_files);
 
-	ret = write(fd, out, out_len);
-	if (ret == -1) {
-		perror("write");
-		return -1;
-	}
-	close(fd);
-
-	return 0;
+	return ret;
 }
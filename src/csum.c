@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Additive and ones-complement checksum helpers
+ *
+ * Data is consumed as 64-bit words split into narrow lanes, and CSUM_LANES
+ * independent accumulators are kept so the compiler can map the inner
+ * loops onto whatever vector unit the host has (SSE/AVX2, NEON, ...).
+ * Lanes are flushed into the 64-bit result before they can overflow, so
+ * the returned sums are exact.
+ */
+
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "csum.h"
+#include "fwstats.h"
+
+#define CSUM_LANES	4
+#define CSUM_STRIDE	(CSUM_LANES * sizeof(uint64_t))
+
+#define MASK_8		0x00ff00ff00ff00ffULL
+#define MASK_16		0x0000ffff0000ffffULL
+
+/* 16-bit lanes take two bytes per word: 0x1fe * 128 still fits */
+#define ADD8_BLOCK	128
+/* 32-bit lanes take two words per word: 0x1fffe * 32768 still fits */
+#define ADD16_BLOCK	32768
+
+static inline uint64_t load64(const uint8_t *p)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+
+static inline uint64_t swab16_lanes(uint64_t w)
+{
+	return ((w & MASK_8) << 8) | ((w >> 8) & MASK_8);
+}
+
+uint64_t csum_add8(uint64_t sum, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t bytes = len;
+	struct fwstats_timer t;
+
+	fwstats_start(&t, FWSTATS_CSUM);
+
+	while (len >= CSUM_STRIDE) {
+		uint64_t acc[CSUM_LANES] = { 0 };
+		size_t n = len / CSUM_STRIDE;
+		int i;
+
+		if (n > ADD8_BLOCK)
+			n = ADD8_BLOCK;
+		len -= n * CSUM_STRIDE;
+
+		while (n--) {
+			for (i = 0; i < CSUM_LANES; i++) {
+				uint64_t w = load64(p + i * sizeof(uint64_t));
+
+				acc[i] += (w & MASK_8) + ((w >> 8) & MASK_8);
+			}
+			p += CSUM_STRIDE;
+		}
+
+		for (i = 0; i < CSUM_LANES; i++) {
+			uint64_t a = acc[i];
+
+			a = (a & MASK_16) + ((a >> 16) & MASK_16);
+			sum += (a & 0xffffffff) + (a >> 32);
+		}
+	}
+
+	while (len--)
+		sum += *p++;
+
+	fwstats_stop(&t, bytes);
+	return sum;
+}
+
+static uint64_t csum_add16_words(uint64_t sum, const void *buf, size_t len,
+				 int swap)
+{
+	const uint8_t *p = buf;
+	size_t bytes = len;
+	struct fwstats_timer t;
+
+	fwstats_start(&t, FWSTATS_CSUM);
+
+	while (len >= CSUM_STRIDE) {
+		uint64_t acc[CSUM_LANES] = { 0 };
+		size_t n = len / CSUM_STRIDE;
+		int i;
+
+		if (n > ADD16_BLOCK)
+			n = ADD16_BLOCK;
+		len -= n * CSUM_STRIDE;
+
+		while (n--) {
+			for (i = 0; i < CSUM_LANES; i++) {
+				uint64_t w = load64(p + i * sizeof(uint64_t));
+
+				if (swap)
+					w = swab16_lanes(w);
+				acc[i] += (w & MASK_16) + ((w >> 16) & MASK_16);
+			}
+			p += CSUM_STRIDE;
+		}
+
+		for (i = 0; i < CSUM_LANES; i++)
+			sum += (acc[i] & 0xffffffff) + (acc[i] >> 32);
+	}
+
+	for (; len > 1; len -= 2, p += 2) {
+		uint16_t w;
+
+		memcpy(&w, p, sizeof(w));
+		if (swap)
+			w = (w << 8) | (w >> 8);
+		sum += w;
+	}
+
+	fwstats_stop(&t, bytes);
+	return sum;
+}
+
+uint64_t csum_add16(uint64_t sum, const void *buf, size_t len)
+{
+	return csum_add16_words(sum, buf, len, 0);
+}
+
+uint64_t csum_add16_le(uint64_t sum, const void *buf, size_t len)
+{
+	return csum_add16_words(sum, buf, len, __BYTE_ORDER == __BIG_ENDIAN);
+}
+
+uint64_t csum_add16_be(uint64_t sum, const void *buf, size_t len)
+{
+	return csum_add16_words(sum, buf, len, __BYTE_ORDER == __LITTLE_ENDIAN);
+}
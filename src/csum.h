@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Additive and ones-complement checksum helpers
+ *
+ * The vendor checksums built on top of these are all plain sums of bytes
+ * or 16-bit words.  The helpers accumulate into wide lanes and leave any
+ * folding, tail handling and vendor quirks to the caller.
+ */
+
+#ifndef csum_h
+#define csum_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* sum of all bytes in buf */
+uint64_t csum_add8(uint64_t sum, const void *buf, size_t len);
+
+/* sum of the len / 2 native endian 16-bit words in buf */
+uint64_t csum_add16(uint64_t sum, const void *buf, size_t len);
+
+/* sum of the len / 2 little endian 16-bit words in buf */
+uint64_t csum_add16_le(uint64_t sum, const void *buf, size_t len);
+
+/* sum of the len / 2 big endian 16-bit words in buf */
+uint64_t csum_add16_be(uint64_t sum, const void *buf, size_t len);
+
+/* fold a sum into 16 bits with end-around carry */
+static inline uint16_t csum_fold16(uint64_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+#endif				/* csum_h */
@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "csum.h"
+#include "fwmap.h"
+
 
 #define IMG_SIZE     0x3e0000
 
@@ -31,44 +34,19 @@ void print_usage(void)
 }
 
 
-unsigned char* read_img(const char *fname)
+unsigned char* read_img(struct fw_map *map, const char *fname)
 {
-  FILE *fp;
-  int size;
-  unsigned char *img;
-
-  fp = fopen(fname, "rb");
-  if (fp == NULL) {
+  if (fw_map_file(map, fname, FW_MAP_WRITE)) {
     perror(app_name);
     exit(-1);
   }
 
-  fseek(fp, 0, SEEK_END);
-  size = ftell(fp);
-  
-  if (size != IMG_SIZE) {
+  if (map->size != IMG_SIZE) {
     fprintf(stderr, "%s: image file has wrong size\n", app_name);
-    fclose(fp);
-    exit(-1);
-  }
-
-  rewind(fp);
-
-  img = malloc(IMG_SIZE);
-  if (img == NULL) {
-    perror(app_name);
-    fclose(fp);
     exit(-1);
   }
 
-  if (fread(img, 1, IMG_SIZE, fp) != IMG_SIZE) {
-    fprintf(stderr, "%s: can't read image file\n", app_name);
-    fclose(fp);
-    exit(-1);
-  }
-
-  fclose(fp);
-  return img;
+  return map->data;
 }
 
 
@@ -225,11 +203,7 @@ void set_checksum(unsigned char*img, unsigned short sum)
 
 int compute_checksum(unsigned char* img)
 {
-  int i;
-  short s=0;
-
-  for (i=0; i<0x3dfffc; i++)
-    s += img[i];
+  short s = csum_add8(0, img, 0x3dfffc);
 
   return s;
 }
@@ -251,6 +225,7 @@ int main(int argc, char* argv[])
 
   int i;
   unsigned char *img;
+  struct fw_map map;
   unsigned short img_checksum;
   unsigned short real_checksum;
 
@@ -330,7 +305,7 @@ int main(int argc, char* argv[])
   }
 
   printf ("** Read firmware file\n");
-  img = read_img(img_fname);
+  img = read_img(&map, img_fname);
 
   printf ("Firmware product: %s\n", img+0x3dffbd);
   printf ("Firmware version: 1.%02d.%02d\n", (img[0x3dffeb] & 0x7f), img[0x3dffec]);
@@ -378,7 +353,7 @@ int main(int argc, char* argv[])
     write_img(img, new_img_fname);
   }
 
-  free(img);
+  fw_unmap_file(&map);
   return 0;
 }
 
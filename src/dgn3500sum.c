@@ -16,7 +16,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+
+#include "fwmap.h"
 
 unsigned char PidDataWW[70] =
 {
@@ -45,50 +46,12 @@ unsigned char PidDataNA[70] =
     0x45, 0x72, 0x43, 0x6F, 0x4D, 0x6D,
 } ;
 
-/* *******************************************************************
-   Reads the file into memory and returns pointer to the buffer. */
-static char *readfile(char *filename, int *size)
-{
-	FILE		*fp;
-	char		*buffer;
-	struct stat	info;
-
-	if (stat(filename,&info)!=0)
-		return NULL;
-
-	if ((fp=fopen(filename,"r"))==NULL)
-		return NULL;
-
-	buffer=NULL;
-	for (;;)
-	{
-		if ((buffer=(char *)malloc(info.st_size+1))==NULL)
-			break;
-
-		if (fread(buffer,1,info.st_size,fp)!=info.st_size)
-		{
-			free(buffer);
-			buffer=NULL;
-			break;
-		}
-
-		buffer[info.st_size]='\0';
-		if(size) *size = info.st_size;
-
-		break;
-	}
-
-	(void)fclose(fp);
-
-	return buffer;
-}
-
-
 /* ******************************************************************* */
 int main(int argc, char** argv)
 {
   unsigned long start, i;
   char *endptr, *buffer, *p;
+  struct fw_map map;
   int count;  // size of file in bytes
   unsigned short sum = 0, sum1 = 0;
   char sumbuf[8 + 8 + 1];
@@ -120,11 +83,12 @@ int main(int argc, char** argv)
   fclose(fp);
 
   /* Read the file to calculate the checksums */
-  buffer = readfile(argv[1], &count);
-  if(!buffer) {
+  if(fw_map_file(&map, argv[1], 0)) {
     printf("ERROR: File %s not found!\n", argv[1]);
     return 1;
   }
+  buffer = map.data;
+  count = map.size;
 
   p = buffer;
   for(i = 0; i < count; i++)
@@ -148,6 +112,6 @@ int main(int argc, char** argv)
   }
   fwrite(sumbuf, 8, sizeof(char), fp);
   fclose(fp);
-  free(buffer);
+  fw_unmap_file(&map);
   return 0;
 }
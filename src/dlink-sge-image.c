@@ -11,6 +11,7 @@
  */
 
 #include "dlink-sge-image.h"
+#include "fwstats.h"
 
 #include <openssl/evp.h>
 #include <openssl/pem.h>
@@ -98,14 +99,31 @@ void image_encrypt(void)
 	EVP_CIPHER_CTX_set_padding(aes_ctx, 0);
 	int outlen;
 
-	while ((read_bytes = fread(&readbuf, 1, BUFSIZE, input_file)) == BUFSIZE) {
+	struct fwstats_timer t;
+
+	for (;;) {
+		fwstats_start(&t, FWSTATS_READ);
+		read_bytes = fread(&readbuf, 1, BUFSIZE, input_file);
+		fwstats_stop(&t, read_bytes);
+		if (read_bytes != BUFSIZE)
+			break;
+
+		fwstats_start(&t, FWSTATS_CSUM);
 		EVP_DigestUpdate(digest_before, &readbuf[0], read_bytes);
+		fwstats_stop(&t, read_bytes);
 		read_total += read_bytes;
 
+		fwstats_start(&t, FWSTATS_CRYPT);
 		EVP_EncryptUpdate(aes_ctx, encbuf, &outlen, &readbuf[0], BUFSIZE);
+		fwstats_stop(&t, BUFSIZE);
+
+		fwstats_start(&t, FWSTATS_WRITE);
 		fwrite(&encbuf, 1, BUFSIZE, output_file);
+		fwstats_stop(&t, BUFSIZE);
 
+		fwstats_start(&t, FWSTATS_CSUM);
 		EVP_DigestUpdate(digest_post, &encbuf[0], BUFSIZE);
+		fwstats_stop(&t, BUFSIZE);
 	}
 
 	// handle last block of data (read_bytes < BUFSIZE)
@@ -268,18 +286,26 @@ void image_decrypt(void)
 	int outlen;
 	pad_len = payload_length_post - payload_length_before;
 
+	struct fwstats_timer t;
+
 	while (read_total < payload_length_post) {
+		fwstats_start(&t, FWSTATS_READ);
 		if (read_total + BUFSIZE <= payload_length_post)
 			read_bytes = fread(&readbuf, 1, BUFSIZE, input_file);
 		else
 			read_bytes = fread(&readbuf, 1, payload_length_post - read_total, \
 				input_file);
+		fwstats_stop(&t, read_bytes);
 
 		read_total += read_bytes;
 
+		fwstats_start(&t, FWSTATS_CSUM);
 		EVP_DigestUpdate(digest_post, &readbuf[0], read_bytes);
+		fwstats_stop(&t, read_bytes);
 
+		fwstats_start(&t, FWSTATS_CRYPT);
 		EVP_DecryptUpdate(aes_ctx, encbuf, &outlen, &readbuf[0], read_bytes);
+		fwstats_stop(&t, read_bytes);
 
 		// only update digest_before until payload_length_before,
 		// do not hash decrypted padding
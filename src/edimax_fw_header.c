@@ -17,6 +17,8 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include "csum.h"
+
 #define MAX_MAGIC_LEN		16
 #define MAX_MODEL_LEN		32
 #define MAX_VERSION_LEN		14
@@ -242,10 +244,7 @@ out:
 
 static unsigned char checksum(unsigned char *p, unsigned len)
 {
-	unsigned char csum = 0;
-
-	while (len--)
-		csum += *p++;
+	unsigned char csum = csum_add8(0, p, len);
 
 	csum ^= 0xb9;
 
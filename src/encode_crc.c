@@ -16,7 +16,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+
+#include "fwmap.h"
 
 // *******************************************************************
 // CCITT polynom G(x)=x^16+x^12+x^5+1
@@ -35,45 +36,6 @@ int make_crc16(int crc, char new)
   return crc & 0xFFFF;
 }
 
-// *******************************************************************
-// Reads the file "filename" into memory and returns pointer to the buffer.
-static char *readfile(char *filename, int *size)
-{
-	FILE		*fp;
-	char		*buffer;
-	struct stat	info;
-	
-	if (stat(filename,&info)!=0)
-		return NULL;
-
-	if ((fp=fopen(filename,"r"))==NULL)
-		return NULL;
-
-	buffer=NULL;
-	for (;;)
-	{
-		if ((buffer=(char *)malloc(info.st_size+1))==NULL)
-			break;
-
-		if (fread(buffer,1,info.st_size,fp)!=info.st_size)
-		{
-			free(buffer);
-			buffer=NULL;
-			break;
-		}
-
-		buffer[info.st_size]='\0';
-		if(size) *size = info.st_size;
-
-		break;
-	}
-
-	(void)fclose(fp);
-
-	return buffer;
-}
-
-
 // *******************************************************************
 int main(int argc, char** argv)
 {
@@ -83,11 +45,14 @@ int main(int argc, char** argv)
   }
 
   int count;  // size of file in bytes
-  char *p, *master = readfile(argv[1], &count);
-  if(!master) {
+  struct fw_map map;
+  char *p, *master;
+  if(fw_map_file(&map, argv[1], FW_MAP_WRITE)) {
     printf("ERROR: File not found!\n");
     return 1;
   }
+  master = map.data;
+  count = map.size;
 
   int crc = 0xFFFF, z;
 
@@ -133,6 +98,6 @@ int main(int argc, char** argv)
   fwrite(master, count, sizeof(char), fp);  // write content
   fclose(fp);
 
-  free(master);
+  fw_unmap_file(&map);
   return 0;
 }
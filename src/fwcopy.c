@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Payload copies that share blocks where the filesystem can
+ *
+ * Each method takes as much of the range as it can and leaves the rest to
+ * the next one: a clone only covers whole blocks, so an unaligned tail is
+ * copied, and copy_file_range() gives up across filesystems on older
+ * kernels or on special files.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "fwcopy.h"
+#include "fwstats.h"
+
+#define FW_COPY_CHUNK	0x40000
+
+#ifdef FICLONERANGE
+static size_t fw_copy_clone(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len)
+{
+	struct file_clone_range range;
+	struct stat st;
+
+	if (fstat(out_fd, &st) || st.st_blksize <= 0)
+		return 0;
+	if (in_off % st.st_blksize || out_off % st.st_blksize)
+		return 0;
+
+	range.src_fd = in_fd;
+	range.src_offset = in_off;
+	range.src_length = len - len % st.st_blksize;
+	range.dest_offset = out_off;
+	if (!range.src_length)
+		return 0;
+
+	fwstats_syscall();
+	if (ioctl(out_fd, FICLONERANGE, &range))
+		return 0;
+
+	return range.src_length;
+}
+#else
+static size_t fw_copy_clone(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len)
+{
+	return 0;
+}
+#endif
+
+static int fw_copy_rw(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len)
+{
+	ssize_t n, w, bytes;
+	char *buf;
+	int err = 0;
+
+	buf = malloc(FW_COPY_CHUNK);
+	if (!buf)
+		return -1;
+	fwstats_alloc(FW_COPY_CHUNK);
+
+	while (len && !err) {
+		n = pread(in_fd, buf, len < FW_COPY_CHUNK ? len : FW_COPY_CHUNK, in_off);
+		fwstats_syscall();
+		if (n <= 0) {
+			if (!n)
+				errno = EIO;
+			err = -1;
+			break;
+		}
+
+		for (w = 0; w < n; w += bytes) {
+			bytes = pwrite(out_fd, buf + w, n - w, out_off + w);
+			fwstats_syscall();
+			if (bytes < 0) {
+				err = -1;
+				break;
+			}
+		}
+
+		in_off += n;
+		out_off += n;
+		len -= n;
+	}
+
+	free(buf);
+
+	return err;
+}
+
+int fw_copy_range(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len)
+{
+	struct fwstats_timer t;
+	size_t total = len;
+	ssize_t n;
+	int err = 0;
+
+	fwstats_start(&t, FWSTATS_WRITE);
+
+	n = fw_copy_clone(in_fd, in_off, out_fd, out_off, len);
+	in_off += n;
+	out_off += n;
+	len -= n;
+
+	while (len) {
+		n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len, 0);
+		fwstats_syscall();
+		if (n <= 0)
+			break;
+		len -= n;
+	}
+
+	if (len)
+		err = fw_copy_rw(in_fd, in_off, out_fd, out_off, len);
+
+	fwstats_stop(&t, total);
+
+	return err;
+}
+
+ssize_t fw_copy_stream(FILE *in, FILE *out)
+{
+	off_t in_off, out_off;
+	struct stat st;
+	char buf[0x4000];
+	ssize_t length = 0;
+	size_t bytes;
+
+	if (fflush(out))
+		return -1;
+
+	in_off = ftello(in);
+	out_off = ftello(out);
+	if (in_off < 0 || out_off < 0 || fstat(fileno(in), &st) || !S_ISREG(st.st_mode)) {
+		/* pipes and the like have to be read as they come */
+		while ((bytes = fread(buf, 1, sizeof(buf), in)) > 0) {
+			if (fwrite(buf, 1, bytes, out) != bytes)
+				return -1;
+			length += bytes;
+		}
+
+		return ferror(in) ? -1 : length;
+	}
+
+	if (st.st_size > in_off)
+		length = st.st_size - in_off;
+
+	if (fw_copy_range(fileno(in), in_off, fileno(out), out_off, length))
+		return -1;
+
+	if (fseeko(in, in_off + length, SEEK_SET) ||
+	    fseeko(out, out_off + length, SEEK_SET))
+		return -1;
+
+	return length;
+}
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Payload copies that share blocks where the filesystem can
+ *
+ * Builders that place an unchanged input file (usually the rootfs) into
+ * their output copy it with these helpers.  If the input and output
+ * positions are both aligned to the filesystem block size, the blocks are
+ * cloned with FICLONERANGE (btrfs, XFS, bcachefs) and cost no space.
+ * Otherwise copy_file_range() lets the kernel copy them without a round
+ * trip through user space, and a plain read/write loop is the last
+ * resort.  The output bytes are the same in every case.
+ */
+
+#ifndef fwcopy_h
+#define fwcopy_h
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/* copy len bytes from in_fd at in_off to out_fd at out_off, 0 or -1 with errno set */
+int fw_copy_range(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len);
+
+/*
+ * Copy the rest of in to out at its current position and leave both
+ * streams positioned after the data.  Returns the number of bytes copied
+ * or -1 with errno set.
+ */
+ssize_t fw_copy_stream(FILE *in, FILE *out);
+
+#endif				/* fwcopy_h */
@@ -0,0 +1,640 @@
+// SPDX-License-Identifier: GPL-2.0-or-later AND BSD-2-Clause
+/*
+ * fwdelta - partition aware binary delta between two firmware images
+ *
+ * Both images are split into partitions (see fwpart.h) and every partition
+ * of the new image is diffed against the partition of the same name in the
+ * old one, so an unchanged root file system costs next to nothing even if
+ * the kernel in front of it changed size.  Partitions are independent and
+ * get diffed by a pool of threads; the result is written in image order,
+ * see fwdelta.h for the format.
+ *
+ * The suffix sorting (split, qsufsort), the match search (matchlen,
+ * search) and the scan loop of delta_diff() are adapted from bsdiff and
+ * are covered by its license:
+ *
+ * Copyright 2003-2005 Colin Percival
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "crc32.h"
+#include "fwdelta.h"
+#include "fwmap.h"
+#include "fwpart.h"
+
+/* 32 bit suffix array indexes halve the memory needed */
+#define FWDELTA_MAX_PART	0x3fffffff
+
+struct delta_buf {
+	uint8_t *data;
+	size_t len;
+	size_t alloc;
+};
+
+struct delta_job {
+	const struct fwpart *part;
+	const uint8_t *old;
+	size_t old_offset;
+	size_t old_size;
+	const uint8_t *new;
+	size_t new_size;
+
+	struct delta_buf out;
+	uint64_t ctrls;
+	int err;
+};
+
+static struct delta_job *jobs;
+static size_t jobs_num;
+static size_t jobs_next;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**************************************************
+ * Output buffers
+ **************************************************/
+
+/* make room for len more bytes and return where they go */
+static uint8_t *delta_buf_reserve(struct delta_buf *buf, size_t len)
+{
+	uint8_t *p;
+
+	if (buf->alloc - buf->len < len) {
+		size_t alloc = buf->alloc ? buf->alloc : 0x10000;
+
+		while (alloc - buf->len < len)
+			alloc *= 2;
+
+		p = realloc(buf->data, alloc);
+		if (!p)
+			return NULL;
+		buf->data = p;
+		buf->alloc = alloc;
+	}
+
+	p = buf->data + buf->len;
+	buf->len += len;
+
+	return p;
+}
+
+static int delta_put_ctrl(struct delta_job *job, uint64_t diff, uint64_t extra, int64_t seek)
+{
+	struct fwdelta_ctrl ctrl = {
+		.diff = htole64(diff),
+		.extra = htole64(extra),
+		.seek = htole64(seek),
+	};
+	uint8_t *p;
+
+	p = delta_buf_reserve(&job->out, sizeof(ctrl));
+	if (!p)
+		return -ENOMEM;
+	memcpy(p, &ctrl, sizeof(ctrl));
+	job->ctrls++;
+
+	return 0;
+}
+
+/**************************************************
+ * Suffix sorting (Larsson & Sadakane qsufsort)
+ **************************************************/
+
+static void split(int32_t *I, int32_t *V, int32_t start, int32_t len, int32_t h)
+{
+	int32_t i, j, k, x, tmp, jj, kk;
+
+	if (len < 16) {
+		for (k = start; k < start + len; k += j) {
+			j = 1;
+			x = V[I[k] + h];
+			for (i = 1; k + i < start + len; i++) {
+				if (V[I[k + i] + h] < x) {
+					x = V[I[k + i] + h];
+					j = 0;
+				}
+				if (V[I[k + i] + h] == x) {
+					tmp = I[k + j];
+					I[k + j] = I[k + i];
+					I[k + i] = tmp;
+					j++;
+				}
+			}
+			for (i = 0; i < j; i++)
+				V[I[k + i]] = k + j - 1;
+			if (j == 1)
+				I[k] = -1;
+		}
+		return;
+	}
+
+	x = V[I[start + len / 2] + h];
+	jj = 0;
+	kk = 0;
+	for (i = start; i < start + len; i++) {
+		if (V[I[i] + h] < x)
+			jj++;
+		if (V[I[i] + h] == x)
+			kk++;
+	}
+	jj += start;
+	kk += jj;
+
+	i = start;
+	j = 0;
+	k = 0;
+	while (i < jj) {
+		if (V[I[i] + h] < x) {
+			i++;
+		} else if (V[I[i] + h] == x) {
+			tmp = I[i];
+			I[i] = I[jj + j];
+			I[jj + j] = tmp;
+			j++;
+		} else {
+			tmp = I[i];
+			I[i] = I[kk + k];
+			I[kk + k] = tmp;
+			k++;
+		}
+	}
+
+	while (jj + j < kk) {
+		if (V[I[jj + j] + h] == x) {
+			j++;
+		} else {
+			tmp = I[jj + j];
+			I[jj + j] = I[kk + k];
+			I[kk + k] = tmp;
+			k++;
+		}
+	}
+
+	if (jj > start)
+		split(I, V, start, jj - start, h);
+
+	for (i = 0; i < kk - jj; i++)
+		V[I[jj + i]] = kk - 1;
+	if (jj == kk - 1)
+		I[jj] = -1;
+
+	if (start + len > kk)
+		split(I, V, kk, start + len - kk, h);
+}
+
+static void qsufsort(int32_t *I, int32_t *V, const uint8_t *old, int32_t oldsize)
+{
+	int32_t buckets[256];
+	int32_t i, h, len;
+
+	memset(buckets, 0, sizeof(buckets));
+	for (i = 0; i < oldsize; i++)
+		buckets[old[i]]++;
+	for (i = 1; i < 256; i++)
+		buckets[i] += buckets[i - 1];
+	for (i = 255; i > 0; i--)
+		buckets[i] = buckets[i - 1];
+	buckets[0] = 0;
+
+	for (i = 0; i < oldsize; i++)
+		I[++buckets[old[i]]] = i;
+	I[0] = oldsize;
+	for (i = 0; i < oldsize; i++)
+		V[i] = buckets[old[i]];
+	V[oldsize] = 0;
+	for (i = 1; i < 256; i++)
+		if (buckets[i] == buckets[i - 1] + 1)
+			I[buckets[i]] = -1;
+	I[0] = -1;
+
+	for (h = 1; I[0] != -(oldsize + 1); h += h) {
+		len = 0;
+		for (i = 0; i < oldsize + 1;) {
+			if (I[i] < 0) {
+				len -= I[i];
+				i -= I[i];
+			} else {
+				if (len)
+					I[i - len] = -len;
+				len = V[I[i]] + 1 - i;
+				split(I, V, i, len, h);
+				i += len;
+				len = 0;
+			}
+		}
+		if (len)
+			I[i - len] = -len;
+	}
+
+	for (i = 0; i < oldsize + 1; i++)
+		I[V[i]] = i;
+}
+
+static int32_t matchlen(const uint8_t *old, int32_t oldsize, const uint8_t *new, int32_t newsize)
+{
+	int32_t i;
+
+	for (i = 0; i < oldsize && i < newsize; i++)
+		if (old[i] != new[i])
+			break;
+
+	return i;
+}
+
+static int32_t search(const int32_t *I, const uint8_t *old, int32_t oldsize,
+		      const uint8_t *new, int32_t newsize, int32_t st, int32_t en,
+		      int32_t *pos)
+{
+	int32_t x, y;
+
+	while (en - st >= 2) {
+		x = st + (en - st) / 2;
+		if (memcmp(old + I[x], new, oldsize - I[x] < newsize ? oldsize - I[x] : newsize) < 0)
+			st = x;
+		else
+			en = x;
+	}
+
+	x = matchlen(old + I[st], oldsize - I[st], new, newsize);
+	y = matchlen(old + I[en], oldsize - I[en], new, newsize);
+	if (x > y) {
+		*pos = I[st];
+		return x;
+	}
+
+	*pos = I[en];
+	return y;
+}
+
+/**************************************************
+ * Diffing
+ **************************************************/
+
+/* emit one triple with its diff and extra bytes */
+static int delta_emit(struct delta_job *job, int32_t lastscan, int32_t lastpos,
+		      int32_t lenf, int32_t extra, int64_t seek)
+{
+	const uint8_t *old = job->old, *new = job->new;
+	uint8_t *p;
+	int32_t i;
+
+	if (delta_put_ctrl(job, lenf, extra, seek))
+		return -ENOMEM;
+
+	p = delta_buf_reserve(&job->out, (size_t)lenf + extra);
+	if (!p)
+		return -ENOMEM;
+
+	for (i = 0; i < lenf; i++)
+		p[i] = new[lastscan + i] - old[lastpos + i];
+	memcpy(p + lenf, new + lastscan + lenf, extra);
+
+	return 0;
+}
+
+static int delta_diff(struct delta_job *job)
+{
+	const uint8_t *old = job->old, *new = job->new;
+	int32_t oldsize = job->old_size, newsize = job->new_size;
+	int32_t scan, pos = 0, len;
+	int32_t lastscan, lastpos, lastoffset;
+	int32_t oldscore, scsc;
+	int32_t s, Sf, lenf, Sb, lenb;
+	int32_t overlap, Ss, lens;
+	int32_t *I, *V;
+	int32_t i;
+	int err = 0;
+
+	if (!oldsize)
+		return newsize ? delta_emit(job, 0, 0, 0, newsize, 0) : 0;
+
+	I = malloc(((size_t)oldsize + 1) * sizeof(*I));
+	V = malloc(((size_t)oldsize + 1) * sizeof(*V));
+	if (!I || !V) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	qsufsort(I, V, old, oldsize);
+	free(V);
+	V = NULL;
+
+	scan = 0;
+	len = 0;
+	lastscan = 0;
+	lastpos = 0;
+	lastoffset = 0;
+	while (scan < newsize) {
+		oldscore = 0;
+
+		for (scsc = scan += len; scan < newsize; scan++) {
+			len = search(I, old, oldsize, new + scan, newsize - scan,
+				     0, oldsize, &pos);
+
+			for (; scsc < scan + len; scsc++)
+				if (scsc + lastoffset < oldsize &&
+				    old[scsc + lastoffset] == new[scsc])
+					oldscore++;
+
+			if ((len == oldscore && len) || len > oldscore + 8)
+				break;
+
+			if (scan + lastoffset < oldsize &&
+			    old[scan + lastoffset] == new[scan])
+				oldscore--;
+		}
+
+		if (len == oldscore && scan != newsize)
+			continue;
+
+		s = 0;
+		Sf = 0;
+		lenf = 0;
+		for (i = 0; lastscan + i < scan && lastpos + i < oldsize;) {
+			if (old[lastpos + i] == new[lastscan + i])
+				s++;
+			i++;
+			if (s * 2 - i > Sf * 2 - lenf) {
+				Sf = s;
+				lenf = i;
+			}
+		}
+
+		lenb = 0;
+		if (scan < newsize) {
+			s = 0;
+			Sb = 0;
+			for (i = 1; scan >= lastscan + i && pos >= i; i++) {
+				if (old[pos - i] == new[scan - i])
+					s++;
+				if (s * 2 - i > Sb * 2 - lenb) {
+					Sb = s;
+					lenb = i;
+				}
+			}
+		}
+
+		if (lastscan + lenf > scan - lenb) {
+			overlap = (lastscan + lenf) - (scan - lenb);
+			s = 0;
+			Ss = 0;
+			lens = 0;
+			for (i = 0; i < overlap; i++) {
+				if (new[lastscan + lenf - overlap + i] ==
+				    old[lastpos + lenf - overlap + i])
+					s++;
+				if (new[scan - lenb + i] == old[pos - lenb + i])
+					s--;
+				if (s > Ss) {
+					Ss = s;
+					lens = i + 1;
+				}
+			}
+			lenf += lens - overlap;
+			lenb -= lens;
+		}
+
+		err = delta_emit(job, lastscan, lastpos, lenf,
+				 (scan - lenb) - (lastscan + lenf),
+				 (int64_t)(pos - lenb) - (lastpos + lenf));
+		if (err)
+			goto out;
+
+		lastscan = scan - lenb;
+		lastpos = pos - lenb;
+		lastoffset = pos - scan;
+	}
+
+out:
+	free(V);
+	free(I);
+	return err;
+}
+
+static void *delta_worker(void *arg)
+{
+	struct delta_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&jobs_lock);
+		job = jobs_next < jobs_num ? &jobs[jobs_next++] : NULL;
+		pthread_mutex_unlock(&jobs_lock);
+
+		if (!job)
+			break;
+
+		job->err = delta_diff(job);
+	}
+
+	return NULL;
+}
+
+/**************************************************
+ * Start
+ **************************************************/
+
+static void usage(void)
+{
+	printf("Usage: fwdelta [options] <old image> <new image> <delta>\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-j <threads>\t\tnumber of partitions diffed in parallel\n");
+	printf("\t-r\t\t\ttreat both images as raw data\n");
+	printf("\n");
+	printf("TRX, Seama, TP-Link safeloader and Luxul images are diffed partition\n");
+	printf("by partition.  Apply the delta with fwpatch.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct fwpart_image old_img, new_img;
+	struct fwdelta_header hdr = {};
+	struct fw_map old_map, new_map;
+	long threads = 0;
+	pthread_t *tids;
+	int raw = 0;
+	size_t total = 0;
+	size_t i;
+	gzFile out;
+	int err = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "j:rh")) != -1) {
+		switch (c) {
+		case 'j':
+			threads = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		default:
+			usage();
+			return 0;
+		}
+	}
+
+	if (argc - optind != 3) {
+		usage();
+		return 1;
+	}
+
+	if (fw_map_file(&old_map, argv[optind], 0)) {
+		fprintf(stderr, "Couldn't open %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	if (fw_map_file(&new_map, argv[optind + 1], 0)) {
+		fprintf(stderr, "Couldn't open %s: %s\n", argv[optind + 1], strerror(errno));
+		err = 1;
+		goto err_unmap_old;
+	}
+
+	fwpart_split(&old_img, old_map.data, old_map.size);
+	fwpart_split(&new_img, new_map.data, new_map.size);
+	if (raw || old_img.type != new_img.type) {
+		fwpart_split_raw(&old_img, old_map.data, old_map.size);
+		fwpart_split_raw(&new_img, new_map.data, new_map.size);
+	}
+
+	jobs_num = new_img.parts;
+	jobs = calloc(jobs_num ? jobs_num : 1, sizeof(*jobs));
+	if (!jobs) {
+		fprintf(stderr, "Out of memory\n");
+		err = 1;
+		goto err_unmap;
+	}
+
+	for (i = 0; i < jobs_num; i++) {
+		const struct fwpart *part = &new_img.part[i];
+		const struct fwpart *old_part = fwpart_find(&old_img, part->name);
+		struct delta_job *job = &jobs[i];
+
+		job->part = part;
+		job->new = new_img.data + part->offset;
+		job->new_size = part->size;
+		if (old_part) {
+			job->old = old_img.data + old_part->offset;
+			job->old_offset = old_part->offset;
+			job->old_size = old_part->size;
+		}
+
+		if (job->new_size > FWDELTA_MAX_PART || job->old_size > FWDELTA_MAX_PART) {
+			fprintf(stderr, "Partition %s is too big\n", part->name);
+			err = 1;
+			goto err_free;
+		}
+	}
+
+	/* Diff all partitions, the main thread helps out */
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > jobs_num)
+		threads = jobs_num;
+
+	tids = calloc(threads > 1 ? threads - 1 : 1, sizeof(*tids));
+	for (i = 0; tids && i + 1 < threads; i++)
+		if (pthread_create(&tids[i], NULL, delta_worker, NULL))
+			break;
+	threads = i;
+	delta_worker(NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+
+	for (i = 0; i < jobs_num; i++) {
+		if (jobs[i].err) {
+			fprintf(stderr, "Couldn't diff partition %s: %s\n",
+				jobs[i].part->name, strerror(-jobs[i].err));
+			err = 1;
+			goto err_free;
+		}
+	}
+
+	/* Write the delta in image order */
+
+	out = gzopen(argv[optind + 2], "wb9");
+	if (!out) {
+		fprintf(stderr, "Couldn't open %s\n", argv[optind + 2]);
+		err = 1;
+		goto err_free;
+	}
+
+	memcpy(hdr.magic, FWDELTA_MAGIC, sizeof(hdr.magic));
+	hdr.type = htole32(new_img.type);
+	hdr.parts = htole32(jobs_num);
+	hdr.old_size = htole64(old_map.size);
+	hdr.new_size = htole64(new_map.size);
+	hdr.old_crc32 = htole32(~crc32_le_update(0xffffffff, old_map.data, old_map.size));
+	hdr.new_crc32 = htole32(~crc32_le_update(0xffffffff, new_map.data, new_map.size));
+	if (gzwrite(out, &hdr, sizeof(hdr)) != sizeof(hdr))
+		err = 1;
+
+	printf("%s image, %zu partitions\n", fwpart_type_name(new_img.type), jobs_num);
+	for (i = 0; i < jobs_num && !err; i++) {
+		struct delta_job *job = &jobs[i];
+		struct fwdelta_part part = {
+			.old_offset = htole64(job->old_offset),
+			.old_size = htole64(job->old_size),
+			.new_size = htole64(job->new_size),
+			.ctrls = htole64(job->ctrls),
+		};
+
+		strncpy(part.name, job->part->name, sizeof(part.name));
+		if (gzwrite(out, &part, sizeof(part)) != sizeof(part) ||
+		    (job->out.len && gzwrite(out, job->out.data, job->out.len) != job->out.len)) {
+			err = 1;
+			break;
+		}
+
+		printf("  %-24s %10zu -> %10zu B, %zu B of delta data\n",
+		       job->part->name, job->old_size, job->new_size, job->out.len);
+		total += job->out.len;
+	}
+
+	if (gzclose(out) != Z_OK)
+		err = 1;
+	if (err)
+		fprintf(stderr, "Couldn't write %s\n", argv[optind + 2]);
+	else
+		printf("%zu B of delta data before compression\n", total);
+
+err_free:
+	for (i = 0; i < jobs_num; i++)
+		free(jobs[i].out.data);
+	free(jobs);
+err_unmap:
+	fw_unmap_file(&new_map);
+err_unmap_old:
+	fw_unmap_file(&old_map);
+	return err;
+}
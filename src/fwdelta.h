@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Firmware delta format shared by fwdelta and fwpatch
+ *
+ * A delta is a gzip stream holding a header and one record per partition
+ * of the new image, in image order.  Each record is followed by its
+ * bsdiff style control triples: "diff" bytes are added to the old
+ * partition data at the current position, "extra" bytes are copied as is
+ * and the old position is moved by "seek" afterwards.  Every triple is
+ * immediately followed by its diff and extra bytes, so the new image can
+ * be written front to back while the delta is being read.
+ *
+ * All fields are little endian.
+ */
+
+#ifndef fwdelta_h
+#define fwdelta_h
+
+#include <stdint.h>
+
+#include "fwpart.h"
+
+#define FWDELTA_MAGIC		"FWDELTA1"
+
+struct fwdelta_header {
+	char magic[8];
+	uint32_t type;			/* enum fwpart_type of the new image */
+	uint32_t parts;
+	uint64_t old_size;
+	uint64_t new_size;
+	uint32_t old_crc32;		/* zlib style CRC-32 of whole images */
+	uint32_t new_crc32;
+} __attribute__ ((packed));
+
+struct fwdelta_part {
+	char name[FWPART_NAME_LEN];
+	uint64_t old_offset;		/* old data the triples refer to */
+	uint64_t old_size;
+	uint64_t new_size;
+	uint64_t ctrls;			/* number of control triples */
+} __attribute__ ((packed));
+
+struct fwdelta_ctrl {
+	uint64_t diff;
+	uint64_t extra;
+	int64_t seek;
+} __attribute__ ((packed));
+
+#endif				/* fwdelta_h */
@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Write-if-different image output to block devices
+ *
+ * A reader thread fills two aligned buffers with the current device
+ * content while the caller compares the other one against the image and,
+ * if it differs, overlays the image data and writes it back.  Reading
+ * block n + 1 thus overlaps with comparing and writing block n.  The
+ * comparison is a plain memcmp(), which the C library already does with
+ * vector instructions.  Without threads the blocks are read in line.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fwdev.h"
+#include "fwstats.h"
+
+/* O_DIRECT buffer alignment, enough for any logical block size */
+#define FW_DEV_ALIGN	4096
+
+struct fw_dev_slot {
+	uint8_t *buf;
+	ssize_t len;		/* bytes read, -1 if the read failed */
+	int err;
+	int ready;
+};
+
+struct fw_dev_ctx {
+	int fd;
+	off_t dev_size;
+	size_t block_size;
+	size_t blocks;
+	struct fw_dev_slot slot[2];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+};
+
+static size_t fw_dev_block_len(const struct fw_dev_ctx *ctx, size_t i)
+{
+	off_t left = ctx->dev_size - (off_t)i * ctx->block_size;
+
+	return left < (off_t)ctx->block_size ? (size_t)left : ctx->block_size;
+}
+
+static void fw_dev_fill(struct fw_dev_ctx *ctx, struct fw_dev_slot *slot, size_t i)
+{
+	size_t len = fw_dev_block_len(ctx, i);
+	off_t offset = (off_t)i * ctx->block_size;
+	struct fwstats_timer t;
+	ssize_t n;
+
+	fwstats_start(&t, FWSTATS_READ);
+	for (slot->len = 0; slot->len < len; slot->len += n) {
+		n = pread(ctx->fd, slot->buf + slot->len, len - slot->len,
+			  offset + slot->len);
+		fwstats_syscall();
+		if (n <= 0) {
+			slot->err = n ? errno : EIO;
+			slot->len = -1;
+			break;
+		}
+	}
+	fwstats_stop(&t, len);
+}
+
+static void *fw_dev_reader(void *arg)
+{
+	struct fw_dev_ctx *ctx = arg;
+	struct fw_dev_slot *slot;
+	size_t i;
+	int stop;
+
+	for (i = 0; i < ctx->blocks; i++) {
+		slot = &ctx->slot[i % 2];
+
+		pthread_mutex_lock(&ctx->lock);
+		while (slot->ready && !ctx->stop)
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+		stop = ctx->stop;
+		pthread_mutex_unlock(&ctx->lock);
+		if (stop)
+			break;
+
+		fw_dev_fill(ctx, slot, i);
+
+		pthread_mutex_lock(&ctx->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->lock);
+
+		if (slot->len < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+static int fw_dev_flush(struct fw_dev_ctx *ctx, const uint8_t *buf, size_t len, off_t offset)
+{
+	struct fwstats_timer t;
+	size_t done;
+	ssize_t n;
+	int err = 0;
+
+	fwstats_start(&t, FWSTATS_WRITE);
+	for (done = 0; done < len; done += n) {
+		n = pwrite(ctx->fd, buf + done, len - done, offset + done);
+		fwstats_syscall();
+		if (n < 0) {
+			err = -1;
+			break;
+		}
+	}
+	fwstats_stop(&t, done);
+
+	return err;
+}
+
+static int fw_dev_open(struct fw_dev_ctx *ctx, const char *dev, size_t size)
+{
+	struct stat st;
+	int flags = O_RDWR;
+
+	if (stat(dev, &st))
+		return -1;
+
+	if (S_ISBLK(st.st_mode)) {
+		if (ctx->block_size % FW_DEV_ALIGN) {
+			errno = EINVAL;
+			return -1;
+		}
+		flags |= O_DIRECT;
+	}
+
+	ctx->fd = open(dev, flags);
+	if (ctx->fd < 0)
+		return -1;
+
+	ctx->dev_size = lseek(ctx->fd, 0, SEEK_END);
+	if (ctx->dev_size < 0 || (uint64_t)ctx->dev_size < size) {
+		if (ctx->dev_size >= 0)
+			errno = ENOSPC;
+		close(ctx->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+int fw_dev_write(const char *dev, const void *data, size_t size,
+		 size_t block_size, struct fw_dev_result *res)
+{
+	struct fw_dev_ctx ctx = {
+		.block_size = block_size,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	const uint8_t *image = data;
+	struct fw_dev_slot *slot;
+	struct fwstats_timer t;
+	pthread_t reader;
+	int threaded;
+	size_t i, len;
+	off_t offset;
+	int err = 0;
+
+	res->blocks = res->written = 0;
+	if (!block_size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (fw_dev_open(&ctx, dev, size))
+		return -1;
+
+	ctx.blocks = (size + block_size - 1) / block_size;
+	res->blocks = ctx.blocks;
+
+	for (i = 0; i < 2; i++) {
+		if (posix_memalign((void **)&ctx.slot[i].buf, FW_DEV_ALIGN, block_size)) {
+			errno = ENOMEM;
+			err = -1;
+			goto out_free;
+		}
+		fwstats_alloc(block_size);
+	}
+
+	threaded = !pthread_create(&reader, NULL, fw_dev_reader, &ctx);
+
+	for (i = 0; i < ctx.blocks; i++) {
+		slot = &ctx.slot[i % 2];
+		offset = (off_t)i * block_size;
+
+		if (threaded) {
+			pthread_mutex_lock(&ctx.lock);
+			while (!slot->ready)
+				pthread_cond_wait(&ctx.cond, &ctx.lock);
+			pthread_mutex_unlock(&ctx.lock);
+		} else {
+			fw_dev_fill(&ctx, slot, i);
+		}
+
+		if (slot->len < 0) {
+			errno = slot->err;
+			err = -1;
+			break;
+		}
+
+		/* the device block may reach past the end of the image */
+		len = size - offset < block_size ? size - offset : block_size;
+
+		fwstats_start(&t, FWSTATS_CSUM);
+		if (memcmp(slot->buf, image + offset, len)) {
+			memcpy(slot->buf, image + offset, len);
+			fwstats_stop(&t, len);
+
+			if (fw_dev_flush(&ctx, slot->buf, slot->len, offset)) {
+				err = -1;
+				break;
+			}
+			res->written++;
+		} else {
+			fwstats_stop(&t, len);
+		}
+
+		pthread_mutex_lock(&ctx.lock);
+		slot->ready = 0;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.lock);
+	}
+
+	if (threaded) {
+		pthread_mutex_lock(&ctx.lock);
+		ctx.stop = 1;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.lock);
+		pthread_join(reader, NULL);
+	}
+
+	if (!err && res->written) {
+		fwstats_syscall();
+		if (fsync(ctx.fd))
+			err = -1;
+	}
+
+out_free:
+	free(ctx.slot[0].buf);
+	free(ctx.slot[1].buf);
+	if (close(ctx.fd) && !err)
+		err = -1;
+
+	return err;
+}
+
+int fw_dev_write_fd(const char *dev, int fd, size_t block_size,
+		    struct fw_dev_result *res)
+{
+	struct stat st;
+	void *data;
+	int err;
+
+	if (fstat(fd, &st))
+		return -1;
+
+	if (!st.st_size)
+		return fw_dev_write(dev, NULL, 0, block_size, res);
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return -1;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	err = fw_dev_write(dev, data, st.st_size, block_size, res);
+	munmap(data, st.st_size);
+
+	return err;
+}
+
+int fw_dev_write_file(const char *dev, const char *image, size_t block_size,
+		      struct fw_dev_result *res)
+{
+	int fd, err;
+
+	fd = open(image, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	err = fw_dev_write_fd(dev, fd, block_size, res);
+	close(fd);
+
+	return err;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Write-if-different image output to block devices
+ *
+ * Instead of leaving a file to be dd'ed onto an SD card or USB flash, a
+ * tool can write its finished image straight to the device.  The device
+ * is read one erase block at a time (with O_DIRECT, so neither side goes
+ * through the page cache) and only blocks whose content differs from the
+ * image are written back.  Reflashing a mostly unchanged image then costs
+ * little more than reading the device.  A regular file works as a target
+ * too, it is just not opened with O_DIRECT.
+ */
+
+#ifndef fwdev_h
+#define fwdev_h
+
+#include <stddef.h>
+
+struct fw_dev_result {
+	size_t blocks;		/* erase blocks the image covers */
+	size_t written;		/* blocks that differed and were written */
+};
+
+/*
+ * Write size bytes at data to the start of dev, skipping the blocks that
+ * already match.  The part of the last block past the image is left
+ * untouched.  Returns 0 or -1 with errno set.
+ */
+int fw_dev_write(const char *dev, const void *data, size_t size,
+		 size_t block_size, struct fw_dev_result *res);
+
+/* same for the contents of the regular file open at fd */
+int fw_dev_write_fd(const char *dev, int fd, size_t block_size,
+		    struct fw_dev_result *res);
+
+/* same for the contents of the file image */
+int fw_dev_write_file(const char *dev, const char *image, size_t block_size,
+		      struct fw_dev_result *res);
+
+#endif				/* fwdev_h */
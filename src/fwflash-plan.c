@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * fwflash-plan - list the erase blocks a flash has to be reprogrammed in
+ *
+ * Compares the erase block hashes of a manifest (written by the image
+ * builders with -m) against a dump of the flash, or the flash device
+ * itself, and prints the ranges whose content differs as
+ * "<offset> <length>" lines.  Neighbouring blocks are merged, so each line
+ * is one erase and program operation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fwmanifest.h"
+
+struct fwflash_manifest {
+	size_t block_size;
+	size_t size;
+	size_t blocks;
+	uint64_t *hash;
+};
+
+static int fwflash_read_manifest(struct fwflash_manifest *m, const char *path)
+{
+	unsigned long long block_size, size, blocks, hash;
+	char algo[16];
+	int version;
+	size_t i;
+	FILE *fp;
+	int err = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return -EACCES;
+	}
+
+	if (fscanf(fp, "fwmanifest %d\n", &version) != 1 || version != 1 ||
+	    fscanf(fp, "hash %15s\n", algo) != 1 || strcmp(algo, "xxh64") ||
+	    fscanf(fp, "block-size %llx\n", &block_size) != 1 || !block_size ||
+	    fscanf(fp, "size %llx\n", &size) != 1 ||
+	    fscanf(fp, "blocks %llu\n", &blocks) != 1 ||
+	    blocks != (size + block_size - 1) / block_size) {
+		fprintf(stderr, "%s is not a valid manifest\n", path);
+		err = -EINVAL;
+		goto out;
+	}
+
+	m->block_size = block_size;
+	m->size = size;
+	m->blocks = blocks;
+	m->hash = calloc(blocks ? blocks : 1, sizeof(*m->hash));
+	if (!m->hash) {
+		fprintf(stderr, "Out of memory\n");
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < blocks; i++) {
+		if (fscanf(fp, "%llx\n", &hash) != 1) {
+			fprintf(stderr, "%s is truncated\n", path);
+			free(m->hash);
+			err = -EINVAL;
+			goto out;
+		}
+		m->hash[i] = hash;
+	}
+
+out:
+	fclose(fp);
+	return err;
+}
+
+static void usage(void)
+{
+	printf("Usage: fwflash-plan [-o <offset>] <manifest> <flash dump>\n");
+	printf("\n");
+	printf("Prints the ranges of <flash dump> that differ from the image of <manifest>.\n");
+	printf("\t-o offset\t\toffset of the image in the flash dump (default: 0)\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct fwflash_manifest m;
+	size_t start = 0, len = 0, differ = 0;
+	uint64_t hash;
+	off_t offset = 0;
+	uint8_t *buf;
+	ssize_t bytes;
+	size_t i;
+	int c, fd;
+	int err = 0;
+
+	while ((c = getopt(argc, argv, "o:")) != -1) {
+		switch (c) {
+		case 'o':
+			offset = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage();
+		return 1;
+	}
+
+	if (fwflash_read_manifest(&m, argv[optind]))
+		return 1;
+
+	buf = malloc(m.block_size);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		err = -ENOMEM;
+		goto err_free_hash;
+	}
+
+	fd = open(argv[optind + 1], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't open %s\n", argv[optind + 1]);
+		err = -EACCES;
+		goto err_free_buf;
+	}
+
+	for (i = 0; i < m.blocks; i++) {
+		size_t pos = i * m.block_size;
+
+		bytes = pread(fd, buf, m.block_size, offset + pos);
+		if (bytes < 0) {
+			fprintf(stderr, "Couldn't read %s: %s\n", argv[optind + 1], strerror(errno));
+			err = -EIO;
+			break;
+		}
+		/*
+		 * A dump that ends inside the image differs; one that ends
+		 * with it (an image file) is padded like the manifest is.
+		 */
+		if (bytes >= m.size - pos || bytes == m.block_size) {
+			if (fw_manifest_hash_block(buf, bytes, m.block_size, &hash)) {
+				fprintf(stderr, "Out of memory\n");
+				err = -ENOMEM;
+				break;
+			}
+			if (hash == m.hash[i])
+				continue;
+		}
+
+		differ++;
+		if (len && start + len == pos) {
+			len += m.block_size;
+			continue;
+		}
+		if (len)
+			printf("0x%08zx 0x%08zx\n", start, len);
+		start = pos;
+		len = m.block_size;
+	}
+	if (!err && len)
+		printf("0x%08zx 0x%08zx\n", start, len);
+
+	if (!err)
+		fprintf(stderr, "%zu of %zu blocks differ\n", differ, m.blocks);
+
+	close(fd);
+err_free_buf:
+	free(buf);
+err_free_hash:
+	free(m.hash);
+	return err ? 1 : 0;
+}
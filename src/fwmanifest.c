@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Erase block hash manifests
+ *
+ * XXH64 follows the reference implementation by Yann Collet (BSD 2-Clause
+ * licensed); it is fast enough to hash the image while it is written and
+ * a flash dump while it is read, which is all it is used for.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fwmanifest.h"
+#include "fwmap.h"
+#include "fwstats.h"
+
+#define XXH_PRIME64_1	0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2	0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3	0x165667b19e3779f9ULL
+#define XXH_PRIME64_4	0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5	0x27d4eb2f165667c5ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t *p)
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+	       (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	       (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	       (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint32_t xxh_read32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = xxh_rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t fw_manifest_hash(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = XXH_PRIME64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -XXH_PRIME64_1;
+
+		do {
+			v1 = xxh64_round(v1, xxh_read64(p));
+			v2 = xxh64_round(v2, xxh_read64(p + 8));
+			v3 = xxh64_round(v3, xxh_read64(p + 16));
+			v4 = xxh64_round(v4, xxh_read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+
+		h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) +
+		    xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = XXH_PRIME64_5;
+	}
+
+	h += len;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= xxh64_round(0, xxh_read64(p));
+		h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (end - p >= 4) {
+		h ^= xxh_read32(p) * XXH_PRIME64_1;
+		h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+int fw_manifest_hash_block(const void *data, size_t len, size_t block_size,
+			   uint64_t *hash)
+{
+	uint8_t *buf;
+
+	if (len >= block_size) {
+		*hash = fw_manifest_hash(data, block_size);
+		return 0;
+	}
+
+	buf = malloc(block_size);
+	if (!buf)
+		return -1;
+
+	memcpy(buf, data, len);
+	memset(buf + len, 0xff, block_size - len);
+	*hash = fw_manifest_hash(buf, block_size);
+	free(buf);
+
+	return 0;
+}
+
+int fw_manifest_write(const char *path, const void *data, size_t size,
+		      size_t block_size)
+{
+	const uint8_t *p = data;
+	struct fwstats_timer t;
+	size_t blocks, i;
+	uint64_t hash;
+	int err = 0;
+	FILE *fp;
+
+	if (!block_size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	blocks = (size + block_size - 1) / block_size;
+	fprintf(fp, "fwmanifest 1\n");
+	fprintf(fp, "hash xxh64\n");
+	fprintf(fp, "block-size 0x%zx\n", block_size);
+	fprintf(fp, "size 0x%zx\n", size);
+	fprintf(fp, "blocks %zu\n", blocks);
+
+	fwstats_start(&t, FWSTATS_CSUM);
+	for (i = 0; i < blocks; i++) {
+		size_t offset = i * block_size;
+
+		err = fw_manifest_hash_block(p + offset, size - offset, block_size, &hash);
+		if (err)
+			break;
+		fprintf(fp, "%016llx\n", (unsigned long long)hash);
+	}
+	fwstats_stop(&t, size);
+
+	if (err || ferror(fp)) {
+		if (!err)
+			errno = EIO;
+		fclose(fp);
+		unlink(path);
+		return -1;
+	}
+
+	err = fclose(fp);
+
+	return err ? -1 : 0;
+}
+
+int fw_manifest_write_file(const char *path, const char *image, size_t block_size)
+{
+	struct fw_map map;
+	int err;
+
+	if (fw_map_file(&map, image, 0))
+		return -1;
+
+	err = fw_manifest_write(path, map.data, map.size, block_size);
+	fw_unmap_file(&map);
+
+	return err;
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Erase block hash manifests
+ *
+ * A manifest lists a 64 bit hash (XXH64) of every erase block an image
+ * covers, so a flasher can skip the blocks that already hold the right
+ * data (see fwflash-plan).  A last partial block is hashed as if padded
+ * with 0xff, which is what the flash holds after erasing and programming
+ * it.  The manifest is plain text:
+ *
+ *	fwmanifest 1
+ *	hash xxh64
+ *	block-size 0x10000
+ *	size 0x<image size>
+ *	blocks <n>
+ *	<n lines with 16 hex digits each>
+ */
+
+#ifndef fwmanifest_h
+#define fwmanifest_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FW_MANIFEST_BLOCK	0x10000
+
+uint64_t fw_manifest_hash(const void *data, size_t len);
+
+/*
+ * Hash one block of the image at data into *hash, short blocks are padded
+ * with 0xff.  Returns 0 or -1 with errno set.
+ */
+int fw_manifest_hash_block(const void *data, size_t len, size_t block_size,
+			   uint64_t *hash);
+
+/* write the manifest of size bytes at data to path, 0 or -1 with errno set */
+int fw_manifest_write(const char *path, const void *data, size_t size,
+		      size_t block_size);
+
+/* same for the contents of the file image */
+int fw_manifest_write_file(const char *path, const char *image, size_t block_size);
+
+#endif				/* fwmanifest_h */
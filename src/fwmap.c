@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Whole file input mappings
+ *
+ * Read-only inputs are mapped straight from the page cache and the kernel
+ * is told they will be read front to back, so readahead stays ahead of the
+ * checksum and copy loops.  Writable inputs are read into anonymous memory
+ * instead: a private file mapping still shares its untouched pages with
+ * the file and faults once the file is truncated, which would break tools
+ * that write their result back over the input.  Transparent huge pages are
+ * requested for that copy.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fwmap.h"
+#include "fwstats.h"
+
+/* set in fw_map.flags when the data lives on the heap */
+#define FW_MAP_HEAP	0x100
+
+static int fw_read_fd(struct fw_map *map, int fd)
+{
+	struct fwstats_timer t;
+	size_t alloc = 0;
+	ssize_t n;
+	void *p;
+
+	fwstats_start(&t, FWSTATS_READ);
+
+	map->data = NULL;
+	map->size = 0;
+	map->flags |= FW_MAP_HEAP;
+
+	for (;;) {
+		if (map->size == alloc) {
+			alloc = alloc ? 2 * alloc : 0x10000;
+			p = realloc(map->data, alloc);
+			if (!p)
+				goto err;
+			map->data = p;
+		}
+
+		n = read(fd, (char *)map->data + map->size, alloc - map->size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			goto err;
+		}
+		if (!n)
+			break;
+		map->size += n;
+	}
+
+	if (!map->size) {
+		free(map->data);
+		map->data = NULL;
+	}
+
+	fwstats_alloc(alloc);
+	fwstats_stop(&t, map->size);
+	return 0;
+
+err:
+	free(map->data);
+	map->data = NULL;
+	fwstats_stop(&t, map->size);
+	return -1;
+}
+
+/* read map->size bytes from fd into a private anonymous mapping */
+static int fw_copy_fd(struct fw_map *map, int fd)
+{
+	struct fwstats_timer t;
+	size_t done = 0;
+	ssize_t n;
+	void *p;
+
+	p = mmap(NULL, map->size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+
+#ifdef MADV_HUGEPAGE
+	madvise(p, map->size, MADV_HUGEPAGE);
+#endif
+	posix_fadvise(fd, 0, map->size, POSIX_FADV_SEQUENTIAL);
+
+	fwstats_start(&t, FWSTATS_READ);
+	while (done < map->size) {
+		n = read(fd, (char *)p + done, map->size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (!n)
+				errno = EIO;
+			fwstats_stop(&t, done);
+			munmap(p, map->size);
+			return -1;
+		}
+		done += n;
+	}
+	fwstats_stop(&t, done);
+	fwstats_alloc(map->size);
+
+	map->data = p;
+	return 0;
+}
+
+int fw_map_file(struct fw_map *map, const char *name, int flags)
+{
+	struct stat st;
+	int ret = -1;
+	int err;
+	int fd;
+
+	map->data = NULL;
+	map->size = 0;
+	map->flags = flags;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0)
+		goto out;
+
+	if (!S_ISREG(st.st_mode)) {
+		ret = fw_read_fd(map, fd);
+		goto out;
+	}
+
+	ret = 0;
+	map->size = st.st_size;
+	if (!map->size)
+		goto out;
+
+	if (flags & FW_MAP_WRITE) {
+		ret = fw_copy_fd(map, fd);
+		if (ret)
+			map->size = 0;
+		goto out;
+	}
+
+	map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map->data == MAP_FAILED) {
+		map->data = NULL;
+		map->size = 0;
+		ret = -1;
+		goto out;
+	}
+
+	madvise(map->data, map->size, MADV_SEQUENTIAL);
+
+out:
+	err = errno;
+	close(fd);
+	errno = err;
+	return ret;
+}
+
+void fw_unmap_file(struct fw_map *map)
+{
+	if (map->flags & FW_MAP_HEAP)
+		free(map->data);
+	else if (map->data)
+		munmap(map->data, map->size);
+
+	map->data = NULL;
+	map->size = 0;
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Whole file input mappings
+ *
+ * Tools that used to malloc() a buffer the size of their input and fread()
+ * it map the file instead: nothing is copied, inputs already in the page
+ * cache cost nothing to "read" and the pages never count against the
+ * tool's private memory.  Inputs that cannot be mapped (pipes, character
+ * devices) are read into a heap buffer, so callers need not care.
+ *
+ * A read-only mapping must not outlive a truncation of its file, so such
+ * inputs cannot double as the output.  Writable inputs are private copies
+ * and may be written back over the file they came from.
+ */
+
+#ifndef fwmap_h
+#define fwmap_h
+
+#include <stddef.h>
+
+/* writable private copy, changes never reach the file */
+#define FW_MAP_WRITE	0x1
+
+struct fw_map {
+	void *data;		/* NULL for an empty file */
+	size_t size;
+	int flags;
+};
+
+/* map name, returns 0 on success or -1 with errno set */
+int fw_map_file(struct fw_map *map, const char *name, int flags);
+
+void fw_unmap_file(struct fw_map *map);
+
+#endif				/* fwmap_h */
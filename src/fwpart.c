@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Container aware partitioning of firmware images
+ *
+ * The layouts follow otrx, oseama, tplink-safeloader and lxlfw; only as
+ * much is parsed as is needed to find the partitions and checksums.  Each
+ * parser records candidate partitions, fwpart_finish() then sorts them,
+ * drops anything outside the image and names the gaps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "fwpart.h"
+#include "md5.h"
+
+#define TRX_MAGIC			0x30524448
+#define TRX_HDR_LEN			28
+#define TRX_FLAGS_OFFSET		12
+#define TRX_MAX_PARTS			3
+
+#define SEAMA_MAGIC			0x5ea3a417
+#define SEAMA_HDR_LEN			28
+
+#define SAFELOADER_PREAMBLE_SIZE	0x14
+#define SAFELOADER_HEADER_SIZE		0x1000
+#define SAFELOADER_QNEW_HEADER_SIZE	0x3c
+#define SAFELOADER_PAYLOAD_TABLE_SIZE	0x800
+
+#define LXL_HDR_V3_LEN			44
+
+/* Salt of the safeloader image MD5, see tplink-safeloader.c */
+static const uint8_t md5_salt[16] = {
+	0x7a, 0x2b, 0x15, 0xed,
+	0x9b, 0x98, 0x59, 0x6d,
+	0xe5, 0x04, 0xab, 0x44,
+	0xac, 0x2a, 0x9f, 0x4e,
+};
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+/* record a candidate partition */
+static void fwpart_add(struct fwpart_image *img, const char *name,
+		       size_t offset, size_t size)
+{
+	struct fwpart *p;
+
+	if (!size || img->parts == FWPART_MAX)
+		return;
+
+	p = &img->part[img->parts++];
+	snprintf(p->name, sizeof(p->name), "%.*s", (int)sizeof(p->name) - 1, name);
+	p->offset = offset;
+	p->size = size;
+}
+
+/* append a final partition, the last one grows once the table is full */
+static void fwpart_put(struct fwpart_image *img, const char *name,
+		       size_t offset, size_t size)
+{
+	struct fwpart *last;
+
+	if (img->parts == FWPART_MAX) {
+		last = &img->part[FWPART_MAX - 1];
+		last->size = offset + size - last->offset;
+		return;
+	}
+
+	fwpart_add(img, name, offset, size);
+}
+
+static void fwpart_gap(struct fwpart_image *img, size_t offset, size_t size,
+		       const char *prev)
+{
+	char name[FWPART_NAME_LEN];
+
+	if (!prev)
+		snprintf(name, sizeof(name), "head");
+	else
+		snprintf(name, sizeof(name), "%.*s.pad", FWPART_NAME_LEN - 5, prev);
+
+	fwpart_put(img, name, offset, size);
+}
+
+static int fwpart_compar(const void *a, const void *b)
+{
+	const struct fwpart *pa = a, *pb = b;
+
+	if (pa->offset != pb->offset)
+		return pa->offset < pb->offset ? -1 : 1;
+
+	return 0;
+}
+
+static void fwpart_finish(struct fwpart_image *img)
+{
+	struct fwpart in[FWPART_MAX];
+	size_t n = img->parts;
+	size_t pos = 0;
+	size_t i;
+
+	memcpy(in, img->part, n * sizeof(*in));
+	qsort(in, n, sizeof(*in), fwpart_compar);
+
+	img->parts = 0;
+	for (i = 0; i < n; i++) {
+		size_t start = in[i].offset;
+		size_t end;
+
+		if (start >= img->size)
+			break;
+
+		end = img->size - start < in[i].size ? img->size : start + in[i].size;
+		if (start < pos)
+			start = pos;
+		if (start >= end)
+			continue;
+
+		if (start > pos)
+			fwpart_gap(img, pos, start - pos,
+				   img->parts ? img->part[img->parts - 1].name : NULL);
+		fwpart_put(img, in[i].name, start, end - start);
+		pos = end;
+	}
+
+	if (pos < img->size)
+		fwpart_put(img, img->parts ? "tail" : "image", pos, img->size - pos);
+}
+
+/**************************************************
+ * TRX
+ **************************************************/
+
+static int fwpart_trx(struct fwpart_image *img)
+{
+	const uint8_t *data = img->data;
+	uint32_t offset[TRX_MAX_PARTS];
+	uint32_t length, first;
+	char name[FWPART_NAME_LEN];
+	int i, j;
+
+	if (img->size < TRX_HDR_LEN || get_le32(data) != TRX_MAGIC)
+		return -1;
+
+	length = get_le32(data + 4);
+	if (length < TRX_HDR_LEN || length > img->size)
+		return -1;
+
+	first = length;
+	for (i = 0; i < TRX_MAX_PARTS; i++) {
+		offset[i] = get_le32(data + 16 + 4 * i);
+		if (offset[i] >= length)
+			offset[i] = 0;
+		if (offset[i] && offset[i] < first)
+			first = offset[i];
+	}
+
+	fwpart_add(img, "trx-header", 0, first);
+	for (i = 0; i < TRX_MAX_PARTS; i++) {
+		uint32_t end = length;
+
+		if (!offset[i])
+			continue;
+		for (j = 0; j < TRX_MAX_PARTS; j++)
+			if (offset[j] > offset[i] && offset[j] < end)
+				end = offset[j];
+
+		snprintf(name, sizeof(name), "trx-part%d", i);
+		fwpart_add(img, name, offset[i], end - offset[i]);
+	}
+
+	return 0;
+}
+
+static int fwpart_trx_verify(const struct fwpart_image *img)
+{
+	uint32_t length = get_le32(img->data + 4);
+	uint32_t crc32;
+
+	crc32 = crc32_le_update(0xffffffff, img->data + TRX_FLAGS_OFFSET,
+				length - TRX_FLAGS_OFFSET);
+	if (crc32 != get_le32(img->data + 8)) {
+		fprintf(stderr, "Invalid TRX crc32: 0x%08x instead of 0x%08x\n",
+			crc32, get_le32(img->data + 8));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**************************************************
+ * Seama
+ **************************************************/
+
+static int fwpart_seama(struct fwpart_image *img)
+{
+	char name[FWPART_NAME_LEN];
+	size_t pos = 0;
+	int i;
+
+	if (img->size < SEAMA_HDR_LEN || get_be32(img->data) != SEAMA_MAGIC)
+		return -1;
+
+	for (i = 0; img->size - pos >= SEAMA_HDR_LEN; i++) {
+		const uint8_t *hdr = img->data + pos;
+		size_t metasize, imagesize;
+
+		if (get_be32(hdr) != SEAMA_MAGIC)
+			break;
+
+		metasize = get_be16(hdr + 6);
+		imagesize = get_be32(hdr + 8);
+		if (img->size - pos - SEAMA_HDR_LEN < metasize + imagesize)
+			break;
+
+		snprintf(name, sizeof(name), "seama%d-header", i);
+		fwpart_add(img, name, pos, SEAMA_HDR_LEN + metasize);
+		pos += SEAMA_HDR_LEN + metasize;
+
+		snprintf(name, sizeof(name), "seama%d", i);
+		fwpart_add(img, name, pos, imagesize);
+		pos += imagesize;
+	}
+
+	return 0;
+}
+
+static int fwpart_seama_verify(const struct fwpart_image *img)
+{
+	uint8_t md5[16];
+	size_t pos = 0;
+	MD5_CTX ctx;
+	int i;
+
+	for (i = 0; img->size - pos >= SEAMA_HDR_LEN; i++) {
+		const uint8_t *hdr = img->data + pos;
+		size_t metasize, imagesize;
+
+		if (get_be32(hdr) != SEAMA_MAGIC)
+			break;
+
+		metasize = get_be16(hdr + 6);
+		imagesize = get_be32(hdr + 8);
+		if (img->size - pos - SEAMA_HDR_LEN < metasize + imagesize)
+			break;
+		pos += SEAMA_HDR_LEN + metasize;
+
+		/* wrapping headers carry no image and no digest */
+		if (!imagesize)
+			continue;
+
+		MD5_Init(&ctx);
+		MD5_Update(&ctx, img->data + pos, imagesize);
+		MD5_Final(md5, &ctx);
+		if (memcmp(md5, hdr + 12, sizeof(md5))) {
+			fprintf(stderr, "Invalid MD5 of Seama entity %d\n", i);
+			return -1;
+		}
+		pos += imagesize;
+	}
+
+	return 0;
+}
+
+/**************************************************
+ * TP-Link safeloader
+ **************************************************/
+
+static size_t fwpart_safeloader_payload(const struct fwpart_image *img)
+{
+	static const size_t offsets[] = {
+		SAFELOADER_PREAMBLE_SIZE + SAFELOADER_HEADER_SIZE,
+		SAFELOADER_PREAMBLE_SIZE + SAFELOADER_QNEW_HEADER_SIZE + SAFELOADER_HEADER_SIZE,
+	};
+	int i;
+
+	if (img->size < SAFELOADER_PREAMBLE_SIZE || get_be32(img->data) != img->size)
+		return 0;
+
+	for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		if (img->size < offsets[i] ||
+		    img->size - offsets[i] < SAFELOADER_PAYLOAD_TABLE_SIZE)
+			continue;
+		if (!memcmp(img->data + offsets[i], "fwup-ptn", 8))
+			return offsets[i];
+	}
+
+	return 0;
+}
+
+static int fwpart_safeloader(struct fwpart_image *img)
+{
+	char table[SAFELOADER_PAYLOAD_TABLE_SIZE + 1];
+	size_t payload;
+	char *line, *end;
+
+	payload = fwpart_safeloader_payload(img);
+	if (!payload)
+		return -1;
+
+	fwpart_add(img, "safeloader-header", 0, payload);
+	fwpart_add(img, "fwup-ptn", payload, SAFELOADER_PAYLOAD_TABLE_SIZE);
+
+	memcpy(table, img->data + payload, SAFELOADER_PAYLOAD_TABLE_SIZE);
+	table[SAFELOADER_PAYLOAD_TABLE_SIZE] = '\0';
+
+	for (line = table; line && !strncmp(line, "fwup-ptn ", 9); line = end) {
+		char name[FWPART_NAME_LEN];
+		unsigned long base, size;
+
+		end = strchr(line, '\n');
+		if (end)
+			*end++ = '\0';
+
+		if (sscanf(line, "fwup-ptn %31s base %lx size %lx", name, &base, &size) != 3)
+			break;
+		if (base > img->size - payload)
+			continue;
+		fwpart_add(img, name, payload + base, size);
+	}
+
+	return 0;
+}
+
+static int fwpart_safeloader_verify(const struct fwpart_image *img)
+{
+	uint8_t md5[16];
+	MD5_CTX ctx;
+
+	MD5_Init(&ctx);
+	MD5_Update(&ctx, md5_salt, sizeof(md5_salt));
+	MD5_Update(&ctx, img->data + SAFELOADER_PREAMBLE_SIZE,
+		   img->size - SAFELOADER_PREAMBLE_SIZE);
+	MD5_Final(md5, &ctx);
+
+	if (memcmp(md5, img->data + 4, sizeof(md5))) {
+		fprintf(stderr, "Invalid safeloader image MD5\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**************************************************
+ * Luxul
+ **************************************************/
+
+static int fwpart_lxl(struct fwpart_image *img)
+{
+	const uint8_t *data = img->data;
+	uint32_t version, hdr_len;
+	uint32_t blobs_offset = 0, blobs_len = 0;
+
+	if (img->size < 12 || memcmp(data, "LXL#", 4))
+		return -1;
+
+	version = get_le32(data + 4);
+	hdr_len = get_le32(data + 8);
+	if (hdr_len > img->size)
+		return -1;
+
+	if (version >= 3 && hdr_len >= LXL_HDR_V3_LEN) {
+		blobs_offset = get_le32(data + 36);
+		blobs_len = get_le32(data + 40);
+		if (blobs_offset > hdr_len || hdr_len - blobs_offset < blobs_len)
+			blobs_offset = blobs_len = 0;
+	}
+
+	fwpart_add(img, "lxl-header", 0, blobs_len ? blobs_offset : hdr_len);
+	fwpart_add(img, "lxl-blobs", blobs_offset, blobs_len);
+	fwpart_add(img, "lxl-data", hdr_len, img->size - hdr_len);
+
+	return 0;
+}
+
+/**************************************************
+ * API
+ **************************************************/
+
+static void fwpart_init(struct fwpart_image *img, const void *data, size_t size)
+{
+	memset(img, 0, sizeof(*img));
+	img->data = data;
+	img->size = size;
+}
+
+void fwpart_split_raw(struct fwpart_image *img, const void *data, size_t size)
+{
+	fwpart_init(img, data, size);
+	fwpart_finish(img);
+}
+
+void fwpart_split(struct fwpart_image *img, const void *data, size_t size)
+{
+	static const struct {
+		enum fwpart_type type;
+		int (*split)(struct fwpart_image *img);
+	} parsers[] = {
+		{ FWPART_TRX, fwpart_trx },
+		{ FWPART_SEAMA, fwpart_seama },
+		{ FWPART_SAFELOADER, fwpart_safeloader },
+		{ FWPART_LXL, fwpart_lxl },
+	};
+	int i;
+
+	fwpart_init(img, data, size);
+
+	for (i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++) {
+		if (!parsers[i].split(img)) {
+			img->type = parsers[i].type;
+			break;
+		}
+		img->parts = 0;
+	}
+
+	fwpart_finish(img);
+}
+
+const char *fwpart_type_name(enum fwpart_type type)
+{
+	switch (type) {
+	case FWPART_TRX:
+		return "TRX";
+	case FWPART_SEAMA:
+		return "Seama";
+	case FWPART_SAFELOADER:
+		return "safeloader";
+	case FWPART_LXL:
+		return "Luxul";
+	default:
+		return "raw";
+	}
+}
+
+const struct fwpart *fwpart_find(const struct fwpart_image *img, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < img->parts; i++)
+		if (!strcmp(img->part[i].name, name))
+			return &img->part[i];
+
+	return NULL;
+}
+
+int fwpart_verify(const struct fwpart_image *img)
+{
+	switch (img->type) {
+	case FWPART_TRX:
+		return fwpart_trx_verify(img);
+	case FWPART_SEAMA:
+		return fwpart_seama_verify(img);
+	case FWPART_SAFELOADER:
+		return fwpart_safeloader_verify(img);
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Container aware partitioning of firmware images
+ *
+ * Splits TRX, Seama, TP-Link safeloader (factory) and Luxul images into
+ * named partitions so tools can handle them one by one.  The partitions
+ * cover the whole image in order; headers, padding and anything behind the
+ * container get partitions of their own.  Images that are not recognized
+ * are a single "image" partition.
+ */
+
+#ifndef fwpart_h
+#define fwpart_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FWPART_NAME_LEN		32
+#define FWPART_MAX		64
+
+enum fwpart_type {
+	FWPART_RAW,
+	FWPART_TRX,
+	FWPART_SEAMA,
+	FWPART_SAFELOADER,
+	FWPART_LXL,
+};
+
+struct fwpart {
+	char name[FWPART_NAME_LEN];
+	size_t offset;
+	size_t size;
+};
+
+struct fwpart_image {
+	enum fwpart_type type;
+	const uint8_t *data;
+	size_t size;
+	size_t parts;
+	struct fwpart part[FWPART_MAX];
+};
+
+/* detect the container of data and split it into partitions */
+void fwpart_split(struct fwpart_image *img, const void *data, size_t size);
+
+/* split data into a single partition, whatever it contains */
+void fwpart_split_raw(struct fwpart_image *img, const void *data, size_t size);
+
+const char *fwpart_type_name(enum fwpart_type type);
+
+const struct fwpart *fwpart_find(const struct fwpart_image *img, const char *name);
+
+/*
+ * Check the checksums the container carries, returns 0 if they match or
+ * the container has none, -1 after printing the mismatch otherwise.
+ */
+int fwpart_verify(const struct fwpart_image *img);
+
+#endif				/* fwpart_h */
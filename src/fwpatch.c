@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * fwpatch - apply a delta made by fwdelta
+ *
+ * The delta is read as a stream (it may come from a pipe) and the new
+ * image is written front to back while doing so; only the old image has to
+ * be available as a whole.  The CRC-32 of the result is checked against the
+ * one recorded in the delta and the checksums of the container itself
+ * (TRX, Seama, safeloader) are verified at the end.  A result that fails
+ * any of these checks is removed.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "crc32.h"
+#include "fwdelta.h"
+#include "fwmap.h"
+#include "fwpart.h"
+
+#define FWPATCH_CHUNK		0x10000
+
+struct fwpatch_ctx {
+	gzFile delta;
+	FILE *out;
+	const char *out_path;
+	const uint8_t *old;		/* old data of the current partition */
+	size_t old_size;
+	uint64_t written;
+	uint32_t crc32;
+	uint8_t buf[FWPATCH_CHUNK];
+};
+
+static int fwpatch_read(struct fwpatch_ctx *ctx, void *buf, size_t len)
+{
+	if (gzread(ctx->delta, buf, len) != len) {
+		fprintf(stderr, "Delta is truncated or corrupted\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int fwpatch_write(struct fwpatch_ctx *ctx, const void *buf, size_t len)
+{
+	if (fwrite(buf, 1, len, ctx->out) != len) {
+		fprintf(stderr, "Couldn't write %zu B to %s\n", len, ctx->out_path);
+		return -EIO;
+	}
+
+	ctx->crc32 = crc32_le_update(ctx->crc32, buf, len);
+	ctx->written += len;
+
+	return 0;
+}
+
+/* add len delta bytes to the old data at pos and write the sum out */
+static int fwpatch_diff(struct fwpatch_ctx *ctx, int64_t pos, uint64_t len)
+{
+	size_t i, n;
+	int err;
+
+	if (pos < 0 || pos > ctx->old_size || len > ctx->old_size - pos) {
+		fprintf(stderr, "Delta refers to data outside the old partition\n");
+		return -EINVAL;
+	}
+
+	while (len) {
+		n = len < sizeof(ctx->buf) ? len : sizeof(ctx->buf);
+
+		err = fwpatch_read(ctx, ctx->buf, n);
+		if (err)
+			return err;
+		for (i = 0; i < n; i++)
+			ctx->buf[i] += ctx->old[pos + i];
+		err = fwpatch_write(ctx, ctx->buf, n);
+		if (err)
+			return err;
+
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int fwpatch_extra(struct fwpatch_ctx *ctx, uint64_t len)
+{
+	size_t n;
+	int err;
+
+	while (len) {
+		n = len < sizeof(ctx->buf) ? len : sizeof(ctx->buf);
+
+		err = fwpatch_read(ctx, ctx->buf, n);
+		if (err)
+			return err;
+		err = fwpatch_write(ctx, ctx->buf, n);
+		if (err)
+			return err;
+
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int fwpatch_part(struct fwpatch_ctx *ctx, const struct fw_map *old_map)
+{
+	struct fwdelta_part part;
+	struct fwdelta_ctrl ctrl;
+	uint64_t old_offset, old_size, new_size, ctrls;
+	uint64_t start = ctx->written;
+	int64_t pos = 0;
+	int err;
+
+	err = fwpatch_read(ctx, &part, sizeof(part));
+	if (err)
+		return err;
+
+	part.name[sizeof(part.name) - 1] = '\0';
+	old_offset = le64toh(part.old_offset);
+	old_size = le64toh(part.old_size);
+	new_size = le64toh(part.new_size);
+	ctrls = le64toh(part.ctrls);
+
+	if (old_offset > old_map->size || old_size > old_map->size - old_offset) {
+		fprintf(stderr, "Partition %s is outside the old image\n", part.name);
+		return -EINVAL;
+	}
+	ctx->old = (const uint8_t *)old_map->data + old_offset;
+	ctx->old_size = old_size;
+
+	while (ctrls--) {
+		uint64_t diff, extra;
+
+		err = fwpatch_read(ctx, &ctrl, sizeof(ctrl));
+		if (err)
+			return err;
+
+		diff = le64toh(ctrl.diff);
+		extra = le64toh(ctrl.extra);
+		if (diff > new_size || extra > new_size - diff ||
+		    ctx->written - start > new_size - diff - extra) {
+			fprintf(stderr, "Partition %s grows beyond its size\n", part.name);
+			return -EINVAL;
+		}
+
+		err = fwpatch_diff(ctx, pos, diff);
+		if (err)
+			return err;
+		err = fwpatch_extra(ctx, extra);
+		if (err)
+			return err;
+
+		pos += diff + (int64_t)le64toh(ctrl.seek);
+	}
+
+	if (ctx->written - start != new_size) {
+		fprintf(stderr, "Partition %s is incomplete\n", part.name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* check the container checksums of the freshly written image */
+static int fwpatch_verify(const char *path, enum fwpart_type type)
+{
+	struct fwpart_image img;
+	struct fw_map map;
+	int err = 0;
+
+	if (type == FWPART_RAW)
+		return 0;
+
+	if (fw_map_file(&map, path, 0)) {
+		fprintf(stderr, "Couldn't reopen %s: %s\n", path, strerror(errno));
+		return -EIO;
+	}
+
+	fwpart_split(&img, map.data, map.size);
+	if (img.type != type) {
+		fprintf(stderr, "Result is not a %s image\n", fwpart_type_name(type));
+		err = -EINVAL;
+	} else if (fwpart_verify(&img)) {
+		err = -EINVAL;
+	}
+
+	fw_unmap_file(&map);
+
+	return err;
+}
+
+static void usage(void)
+{
+	printf("Usage: fwpatch <old image> <delta> <new image>\n");
+	printf("\n");
+	printf("Applies a delta created by fwdelta. Use - to read the delta from stdin.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct fwpatch_ctx *ctx;
+	struct fwdelta_header hdr;
+	struct fw_map old_map;
+	uint32_t parts, i;
+	int err = 0;
+
+	if (argc != 4) {
+		usage();
+		return 1;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	ctx->out_path = argv[3];
+
+	if (fw_map_file(&old_map, argv[1], 0)) {
+		fprintf(stderr, "Couldn't open %s: %s\n", argv[1], strerror(errno));
+		err = -EACCES;
+		goto err_free;
+	}
+
+	if (!strcmp(argv[2], "-"))
+		ctx->delta = gzdopen(dup(STDIN_FILENO), "rb");
+	else
+		ctx->delta = gzopen(argv[2], "rb");
+	if (!ctx->delta) {
+		fprintf(stderr, "Couldn't open %s\n", argv[2]);
+		err = -EACCES;
+		goto err_unmap;
+	}
+	gzbuffer(ctx->delta, 0x40000);
+
+	err = fwpatch_read(ctx, &hdr, sizeof(hdr));
+	if (err)
+		goto err_close_delta;
+
+	if (memcmp(hdr.magic, FWDELTA_MAGIC, sizeof(hdr.magic))) {
+		fprintf(stderr, "%s is not a firmware delta\n", argv[2]);
+		err = -EINVAL;
+		goto err_close_delta;
+	}
+
+	if (le64toh(hdr.old_size) != old_map.size ||
+	    ~crc32_le_update(0xffffffff, old_map.data, old_map.size) != le32toh(hdr.old_crc32)) {
+		fprintf(stderr, "Delta wasn't made against %s\n", argv[1]);
+		err = -EINVAL;
+		goto err_close_delta;
+	}
+
+	ctx->out = fopen(ctx->out_path, "w");
+	if (!ctx->out) {
+		fprintf(stderr, "Couldn't open %s\n", ctx->out_path);
+		err = -EACCES;
+		goto err_close_delta;
+	}
+
+	ctx->crc32 = 0xffffffff;
+	parts = le32toh(hdr.parts);
+	for (i = 0; i < parts && !err; i++)
+		err = fwpatch_part(ctx, &old_map);
+
+	if (fclose(ctx->out) && !err) {
+		fprintf(stderr, "Couldn't write %s\n", ctx->out_path);
+		err = -EIO;
+	}
+
+	if (!err && (ctx->written != le64toh(hdr.new_size) ||
+		     ~ctx->crc32 != le32toh(hdr.new_crc32))) {
+		fprintf(stderr, "Invalid crc32 of the new image: 0x%08x instead of 0x%08x\n",
+			~ctx->crc32, le32toh(hdr.new_crc32));
+		err = -EINVAL;
+	}
+
+	if (!err)
+		err = fwpatch_verify(ctx->out_path, le32toh(hdr.type));
+
+	if (err)
+		unlink(ctx->out_path);
+	else
+		printf("Wrote %ju B to %s\n", (uintmax_t)ctx->written, ctx->out_path);
+
+err_close_delta:
+	gzclose(ctx->delta);
+err_unmap:
+	fw_unmap_file(&old_map);
+err_free:
+	free(ctx);
+	return err ? 1 : 0;
+}
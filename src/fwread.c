@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Read-ahead for stream-through-checksum loops
+ *
+ * The reader thread is the only user of the stream while it runs.  It fills
+ * slots in order and never reads past the requested length, so the stream
+ * position after a complete pass matches a synchronous loop.  If the thread
+ * cannot be started the chunks are read synchronously by the caller.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "fwread.h"
+#include "fwstats.h"
+
+#define FW_READ_SLOTS	4
+#define FW_READ_CHUNK	0x40000
+
+struct fw_reader {
+	FILE *fp;
+	uint64_t left;		/* bytes the thread still has to read */
+	size_t chunk;
+	uint8_t *buf;		/* FW_READ_SLOTS chunks */
+	size_t len[FW_READ_SLOTS];
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int threaded;
+
+	unsigned int head;	/* slots filled so far */
+	unsigned int tail;	/* slots given back so far */
+	int held;		/* the caller holds slot tail */
+	int done;		/* nothing more will be filled */
+	int stop;		/* the caller is not interested any more */
+	int err;		/* errno of a failed read */
+};
+
+/* fill one slot, returns non-zero once there is nothing more to read */
+static int fw_reader_fill(struct fw_reader *r, unsigned int slot)
+{
+	size_t want = r->left < r->chunk ? r->left : r->chunk;
+	size_t got = 0;
+
+	/* chunks are larger than the stdio buffer, so this is one read(2) */
+	if (want) {
+		got = fread(r->buf + (size_t)slot * r->chunk, 1, want, r->fp);
+		fwstats_syscall();
+	}
+
+	r->len[slot] = got;
+	r->left -= got;
+	if (got < want && ferror(r->fp))
+		r->err = errno ? errno : EIO;
+
+	return got < want || !r->left;
+}
+
+static void *fw_reader_thread(void *arg)
+{
+	struct fw_reader *r = arg;
+	unsigned int slot;
+	int last;
+
+	pthread_mutex_lock(&r->lock);
+	while (!r->done) {
+		while (r->head - r->tail == FW_READ_SLOTS && !r->stop)
+			pthread_cond_wait(&r->cond, &r->lock);
+		if (r->stop)
+			break;
+
+		slot = r->head % FW_READ_SLOTS;
+		pthread_mutex_unlock(&r->lock);
+
+		last = fw_reader_fill(r, slot);
+
+		pthread_mutex_lock(&r->lock);
+		if (r->len[slot])
+			r->head++;
+		r->done = last;
+		pthread_cond_broadcast(&r->cond);
+	}
+	r->done = 1;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+struct fw_reader *fw_reader_open(FILE *fp, uint64_t len)
+{
+	struct fw_reader *r;
+	void *buf;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->fp = fp;
+	r->left = len;
+	r->chunk = FW_READ_CHUNK;
+	if (len < r->chunk)
+		r->chunk = (len + 4095) & ~(size_t)4095;
+	if (!r->chunk)
+		r->chunk = 4096;
+
+	if (posix_memalign(&buf, 4096, FW_READ_SLOTS * r->chunk)) {
+		free(r);
+		return NULL;
+	}
+	r->buf = buf;
+	fwstats_alloc(FW_READ_SLOTS * r->chunk);
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	r->threaded = !pthread_create(&r->thread, NULL, fw_reader_thread, r);
+
+	return r;
+}
+
+size_t fw_reader_next(struct fw_reader *r, const uint8_t **buf)
+{
+	struct fwstats_timer t;
+	unsigned int slot;
+	size_t len = 0;
+
+	fwstats_start(&t, FWSTATS_READ);
+
+	if (!r->threaded) {
+		if (!r->done) {
+			r->done = fw_reader_fill(r, 0);
+			len = r->len[0];
+		}
+		*buf = r->buf;
+		fwstats_stop(&t, len);
+		return len;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	if (r->held) {
+		r->tail++;
+		r->held = 0;
+		pthread_cond_broadcast(&r->cond);
+	}
+	while (r->head == r->tail && !r->done)
+		pthread_cond_wait(&r->cond, &r->lock);
+	if (r->head != r->tail) {
+		slot = r->tail % FW_READ_SLOTS;
+		*buf = r->buf + (size_t)slot * r->chunk;
+		len = r->len[slot];
+		r->held = 1;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	fwstats_stop(&t, len);
+	return len;
+}
+
+int fw_reader_close(struct fw_reader *r)
+{
+	int err;
+
+	if (r->threaded) {
+		pthread_mutex_lock(&r->lock);
+		r->stop = 1;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		pthread_join(r->thread, NULL);
+	}
+
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->lock);
+
+	err = r->err;
+	free(r->buf);
+	free(r);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Read-ahead for stream-through-checksum loops
+ *
+ * A background thread keeps a small ring of large buffers filled from a
+ * stdio stream while the caller checksums, encrypts or writes the buffer it
+ * was handed last, so disk and CPU work overlap.  The stream must not be
+ * touched by the caller between fw_reader_open() and fw_reader_close();
+ * after a complete pass it is left positioned right after the data read,
+ * exactly as a plain fread() loop would have left it.
+ */
+
+#ifndef fwread_h
+#define fwread_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* read until EOF */
+#define FW_READ_ALL	UINT64_MAX
+
+struct fw_reader;
+
+/* start reading at most len bytes from fp, NULL if out of memory */
+struct fw_reader *fw_reader_open(FILE *fp, uint64_t len);
+
+/*
+ * Hand out the next chunk and return its size, 0 once len bytes were read,
+ * EOF was hit or a read failed.  The previous chunk is given back.
+ */
+size_t fw_reader_next(struct fw_reader *r, const uint8_t **buf);
+
+/* stop reading, returns 0 or -1 with errno set if a read failed */
+int fw_reader_close(struct fw_reader *r);
+
+#endif				/* fwread_h */
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Lightweight run time statistics for the firmware tools
+ */
+
+#define _GNU_SOURCE	/* program_invocation_short_name in errno.h */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fwstats.h"
+
+struct fwstats_counter {
+	uint64_t ns;
+	uint64_t bytes;
+	uint64_t calls;
+};
+
+static const char * const fwstats_phase_names[FWSTATS_PHASES] = {
+	[FWSTATS_READ]	= "read",
+	[FWSTATS_CSUM]	= "checksum",
+	[FWSTATS_CRYPT]	= "crypt",
+	[FWSTATS_WRITE]	= "write",
+};
+
+int fwstats_state = -1;
+
+static struct fwstats_counter fwstats_phases[FWSTATS_PHASES];
+static uint64_t fwstats_allocs;
+static uint64_t fwstats_alloc_bytes;
+static uint64_t fwstats_syscalls;
+static uint64_t fwstats_t0;	/* first instrumented call, wall_ns counts from here */
+
+static uint64_t fwstats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fwstats_dump(void)
+{
+	int i;
+
+	fprintf(stderr, "{\"tool\":\"%s\",\"wall_ns\":%llu",
+		program_invocation_short_name,
+		(unsigned long long)(fwstats_now() - fwstats_t0));
+
+	for (i = 0; i < FWSTATS_PHASES; i++)
+		fprintf(stderr, ",\"%s\":{\"ns\":%llu,\"bytes\":%llu,\"calls\":%llu}",
+			fwstats_phase_names[i],
+			(unsigned long long)fwstats_phases[i].ns,
+			(unsigned long long)fwstats_phases[i].bytes,
+			(unsigned long long)fwstats_phases[i].calls);
+
+	fprintf(stderr, ",\"allocs\":%llu,\"alloc_bytes\":%llu,\"syscalls\":%llu}\n",
+		(unsigned long long)fwstats_allocs,
+		(unsigned long long)fwstats_alloc_bytes,
+		(unsigned long long)__atomic_load_n(&fwstats_syscalls, __ATOMIC_RELAXED));
+}
+
+int fwstats_init(void)
+{
+	const char *env = getenv("FWUTIL_STATS");
+
+	fwstats_state = env && !strcmp(env, "json");
+	if (fwstats_state) {
+		fwstats_t0 = fwstats_now();
+		atexit(fwstats_dump);
+	}
+
+	return fwstats_state;
+}
+
+void fwstats_start(struct fwstats_timer *t, enum fwstats_phase phase)
+{
+	t->phase = phase;
+	t->start = fwstats_enabled() ? fwstats_now() : 0;
+}
+
+void fwstats_stop(struct fwstats_timer *t, uint64_t bytes)
+{
+	struct fwstats_counter *c = &fwstats_phases[t->phase];
+
+	if (!fwstats_enabled())
+		return;
+
+	c->ns += fwstats_now() - t->start;
+	c->bytes += bytes;
+	c->calls++;
+}
+
+void fwstats_alloc(size_t size)
+{
+	if (!fwstats_enabled())
+		return;
+
+	fwstats_allocs++;
+	fwstats_alloc_bytes += size;
+}
+
+void fwstats_syscall(void)
+{
+	if (!fwstats_enabled())
+		return;
+
+	/* reader threads count their reads too */
+	__atomic_fetch_add(&fwstats_syscalls, 1, __ATOMIC_RELAXED);
+}
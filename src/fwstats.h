@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Lightweight run time statistics for the firmware tools
+ *
+ * Shared helpers wrap their hot paths in phase timers and report how many
+ * bytes each call handled, and count the I/O system calls and allocations
+ * they make.  Nothing is measured unless FWUTIL_STATS=json is set in the
+ * environment; then a single JSON object with the collected numbers is
+ * printed to stderr when the tool exits.  Its wall_ns is the time since
+ * the first instrumented call, not since the process started.
+ */
+
+#ifndef fwstats_h
+#define fwstats_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum fwstats_phase {
+	FWSTATS_READ,
+	FWSTATS_CSUM,
+	FWSTATS_CRYPT,
+	FWSTATS_WRITE,
+	FWSTATS_PHASES
+};
+
+struct fwstats_timer {
+	enum fwstats_phase phase;
+	uint64_t start;
+};
+
+extern int fwstats_state;
+
+int fwstats_init(void);
+
+/* non-zero when statistics are being collected */
+static inline int fwstats_enabled(void)
+{
+	return fwstats_state < 0 ? fwstats_init() : fwstats_state;
+}
+
+void fwstats_start(struct fwstats_timer *t, enum fwstats_phase phase);
+
+/* stop the timer and account one call handling bytes bytes */
+void fwstats_stop(struct fwstats_timer *t, uint64_t bytes);
+
+/* account one allocation of size bytes */
+void fwstats_alloc(size_t size);
+
+/* account one read, write, copy or sync system call, safe from any thread */
+void fwstats_syscall(void);
+
+#endif				/* fwstats_h */
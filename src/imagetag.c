@@ -19,6 +19,8 @@
 #include "bcm_tag.h"
 #include "imagetag_cmdline.h"
 #include "cyg_crc.h"
+#include "crc32.h"
+#include "fwread.h"
 
 #define DEADCODE			0xDEADC0DE
 
@@ -38,27 +40,39 @@ void int2tag(char *tag, uint32_t value) {
 
 uint32_t compute_crc32(uint32_t crc, FILE *binfile, size_t compute_start, size_t compute_len)
 {
-	uint8_t readbuf[1024];
+	struct fw_reader *rd;
+	const uint8_t *readbuf;
 	size_t read;
 
-	fseek(binfile, compute_start, SEEK_SET);
+	if (!binfile)
+		return crc;
 
-	/* read block of 1024 bytes */
-	while (binfile && !feof(binfile) && !ferror(binfile) && (compute_len >= sizeof(readbuf))) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), binfile);
-		crc = cyg_crc32_accumulate(crc, readbuf, read);
-		compute_len = compute_len - read;
-	}
+	fseek(binfile, compute_start, SEEK_SET);
 
-	/* Less than 1024 bytes remains, read compute_len bytes */
-	if (binfile && !feof(binfile) && !ferror(binfile) && (compute_len > 0)) {
-		read = fread(readbuf, sizeof(uint8_t), compute_len, binfile);
-		crc = cyg_crc32_accumulate(crc, readbuf, read);
-	}
+	rd = fw_reader_open(binfile, compute_len);
+	if (!rd)
+		return crc;
+	while ((read = fw_reader_next(rd, &readbuf)) > 0)
+		crc = cyg_crc32_accumulate(crc, (void *)readbuf, read);
+	fw_reader_close(rd);
 
 	return crc;
 }
 
+/* append everything left in infile to outfile */
+static void copy_file(FILE *infile, FILE *outfile)
+{
+	struct fw_reader *rd;
+	const uint8_t *readbuf;
+	size_t read;
+
+	if (!infile || !(rd = fw_reader_open(infile, FW_READ_ALL)))
+		return;
+	while ((read = fw_reader_next(rd, &readbuf)) > 0)
+		fwrite(readbuf, sizeof(uint8_t), read, outfile);
+	fw_reader_close(rd);
+}
+
 size_t getlen(FILE *fp)
 {
 	size_t retval, curpos;
@@ -83,9 +97,8 @@ int tagfile(const char *kernel, const char *rootfs, const char *bin, \
 	struct kernelhdr khdr;
 	FILE *kernelfile = NULL, *rootfsfile = NULL, *binfile = NULL, *cfefile = NULL;
 	size_t cfelen, kerneloff, kernellen, rootfsoff, rootfslen, \
-	  read, imagelen, rootfsoffpadlen = 0, oldrootfslen, \
+	  imagelen, rootfsoffpadlen = 0, oldrootfslen, \
 	  rootfsend;
-	uint8_t readbuf[1024];
 	uint32_t imagecrc = IMAGETAG_CRC_START;
 	uint32_t kernelcrc = IMAGETAG_CRC_START;
 	uint32_t rootfscrc = IMAGETAG_CRC_START;
@@ -130,10 +143,7 @@ int tagfile(const char *kernel, const char *rootfs, const char *bin, \
 	  fseek(binfile, sizeof(tag), SEEK_SET);
 	  
 	  /* Write the cfe */
-	  while (cfefile && !feof(cfefile) && !ferror(cfefile)) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), cfefile);
-		fwrite(readbuf, sizeof(uint8_t), read, binfile);
-	  }
+	  copy_file(cfefile, binfile);
 
 	} else {
 	  cfelen = 0;
@@ -178,17 +188,11 @@ int tagfile(const char *kernel, const char *rootfs, const char *bin, \
 	  fwrite(&khdr, sizeof(khdr), 1, binfile);
 	  
 	  /* Write the kernel */
-	  while (kernelfile && !feof(kernelfile) && !ferror(kernelfile)) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), kernelfile);
-		fwrite(readbuf, sizeof(uint8_t), read, binfile);
-	  }
+	  copy_file(kernelfile, binfile);
 
 	  /* Write the RootFS */
 	  fseek(binfile, rootfsoff - fwaddr + cfelen, SEEK_SET);
-	  while (rootfsfile && !feof(rootfsfile) && !ferror(rootfsfile)) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), rootfsfile);
-		fwrite(readbuf, sizeof(uint8_t), read, binfile);
-	  }
+	  copy_file(rootfsfile, binfile);
 
 	  /* Align image to specified erase block size and append deadc0de */
 	  printf("Data alignment to %dk with 'deadc0de' appended\n", block_size/1024);
@@ -260,17 +264,11 @@ int tagfile(const char *kernel, const char *rootfs, const char *bin, \
 	  }
 	  
 	  /* Write the kernel */
-	  while (kernelfile && !feof(kernelfile) && !ferror(kernelfile)) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), kernelfile);
-		fwrite(readbuf, sizeof(uint8_t), read, binfile);
-	  }
+	  copy_file(kernelfile, binfile);
 
 	  /* Write the RootFS */
 	  fseek(binfile, rootfsoff - fwaddr + cfelen, SEEK_SET);
-	  while (rootfsfile && !feof(rootfsfile) && !ferror(rootfsfile)) {
-		read = fread(readbuf, sizeof(uint8_t), sizeof(readbuf), rootfsfile);
-		fwrite(readbuf, sizeof(uint8_t), read, binfile);
-	  }
+	  copy_file(rootfsfile, binfile);
 
 	  /* Flush the binfile buffer so that when we read from file, it contains
 	   * everything in the buffer
@@ -385,6 +383,123 @@ int tagfile(const char *kernel, const char *rootfs, const char *bin, \
 	return 0;
 }
 
+uint32_t tag2int(const char *tag) {
+  uint32_t network;
+  memcpy(&network, tag, 4);
+  return ntohl(network);
+}
+
+/* Update the CRC of [start, start + len) for the part of the patch inside it */
+static uint32_t patch_region_crc(uint32_t crc, size_t start, size_t len, size_t offset,
+				 const uint8_t *old, const uint8_t *new, size_t patchlen)
+{
+	size_t from = offset > start ? offset : start;
+	size_t to = offset + patchlen < start + len ? offset + patchlen : start + len;
+
+	if (from >= to)
+		return crc;
+
+	return crc32_le_patch(crc, len, from - start, old + (from - offset),
+			      new + (from - offset), to - from);
+}
+
+/*
+ * Replace bytes of an existing image and update the tag CRCs from the
+ * replaced bytes only (CRC32 is linear), instead of rereading the image.
+ */
+int patchfile(const char *bin, size_t offset, const char *patch)
+{
+	struct bcm_tag tag;
+	FILE *binfile = NULL, *datafile = NULL;
+	uint8_t *old = NULL, *new = NULL;
+	size_t patchlen, cfelen, base, kerneloff, kernellen, rootfsoff, rootfslen;
+	uint32_t kernelcrc, kernelfscrc, imagecrc;
+	int image_is_kernel;
+	int ret = 1;
+
+	if (!(datafile = fopen(patch, "rb"))) {
+		fprintf(stderr, "Unable to open patch \"%s\"\n", patch);
+		goto out;
+	}
+	patchlen = getlen(datafile);
+
+	if (!(binfile = fopen(bin, "rb+")) || fread(&tag, sizeof(tag), 1, binfile) != 1) {
+		fprintf(stderr, "Unable to read image \"%s\"\n", bin);
+		goto out;
+	}
+
+	if (tag2int(tag.headerCRC) != cyg_crc32_accumulate(IMAGETAG_CRC_START, (uint8_t*)&tag, sizeof(tag) - 20)) {
+		fprintf(stderr, "Image \"%s\" has an invalid tag\n", bin);
+		goto out;
+	}
+
+	if (offset < sizeof(tag) || offset + patchlen > getlen(binfile)) {
+		fprintf(stderr, "Patch doesn't fit between the tag and the end of the image\n");
+		goto out;
+	}
+
+	/* Translate flash addresses from the tag into file offsets */
+	cfelen = strtoul(tag.cfeLength, NULL, 10);
+	kerneloff = strtoul(tag.kernelAddress, NULL, 10);
+	kernellen = strtoul(tag.kernelLength, NULL, 10);
+	rootfsoff = strtoul(tag.flashImageStart, NULL, 10);
+	rootfslen = strtoul(tag.flashRootLength, NULL, 10);
+	base = (kerneloff < rootfsoff ? kerneloff : rootfsoff) - sizeof(tag) - cfelen;
+	kerneloff -= base;
+	rootfsoff -= base;
+
+	if (!(old = malloc(patchlen)) || !(new = malloc(patchlen))) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	fseek(binfile, offset, SEEK_SET);
+	if (fread(new, 1, patchlen, datafile) != patchlen || fread(old, 1, patchlen, binfile) != patchlen) {
+		fprintf(stderr, "Unable to read patch data\n");
+		goto out;
+	}
+
+	kernelcrc = tag2int(tag.kernelCRC);
+	kernelfscrc = tag2int(tag.fskernelCRC);
+	imagecrc = tag2int(tag.imageCRC);
+	/* imageCRC duplicates kernelCRC on Pirelli boards, fskernelCRC elsewhere */
+	image_is_kernel = imagecrc != kernelfscrc && imagecrc == kernelcrc;
+
+	kernelcrc = patch_region_crc(kernelcrc, kerneloff, kernellen, offset, old, new, patchlen);
+	kernelfscrc = patch_region_crc(kernelfscrc, kerneloff < rootfsoff ? kerneloff : rootfsoff,
+				       kernellen + rootfslen, offset, old, new, patchlen);
+
+	int2tag(tag.rootfsCRC, patch_region_crc(tag2int(tag.rootfsCRC), rootfsoff, rootfslen,
+						offset, old, new, patchlen));
+	int2tag(tag.kernelCRC, kernelcrc);
+	int2tag(tag.fskernelCRC, kernelfscrc);
+	int2tag(tag.imageCRC, image_is_kernel ? kernelcrc : kernelfscrc);
+	int2tag(tag.headerCRC, cyg_crc32_accumulate(IMAGETAG_CRC_START, (uint8_t*)&tag, sizeof(tag) - 20));
+
+	fseek(binfile, offset, SEEK_SET);
+	if (fwrite(new, 1, patchlen, binfile) != patchlen) {
+		fprintf(stderr, "Unable to write patch data\n");
+		goto out;
+	}
+
+	fseek(binfile, 0L, SEEK_SET);
+	if (fwrite(&tag, sizeof(uint8_t), sizeof(tag), binfile) != sizeof(tag)) {
+		fprintf(stderr, "Unable to write tag\n");
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	free(new);
+	free(old);
+	if (binfile)
+		fclose(binfile);
+	if (datafile)
+		fclose(datafile);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	char *kernel, *rootfs, *bin;
@@ -394,6 +509,14 @@ int main(int argc, char **argv)
 
 	kernel = rootfs = bin = NULL;
 
+	if (argc > 1 && !strcmp(argv[1], "patch")) {
+	  if (argc != 5) {
+		fprintf(stderr, "Usage: %s patch <image> <offset> <file>\n", argv[0]);
+		exit(1);
+	  }
+	  return patchfile(argv[2], strtoul(argv[3], NULL, 0), argv[4]);
+	}
+
 	if (imagetag_cmdline(argc, argv, &parsed_args)) {
 	  exit(1);
 	}
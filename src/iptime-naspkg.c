@@ -23,6 +23,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "csum.h"
+
 #if !defined(__BYTE_ORDER)
 #error "Unknown byte order"
 #endif
@@ -135,12 +137,9 @@ char *get_ctime(void)
 
 uint32_t make_checksum(const char *model_name, uint8_t *bytes, int length)
 {
-	int i;
-	uint32_t sum = 0;
+	uint32_t sum = csum_add8(0, bytes, length);
 	uint32_t magic = 0x19283745;
 
-	for (i = 0; i < length; i++)
-		sum += bytes[i];
 	return ((uint32_t)strlen(model_name) * magic + ~sum) ^ sum;
 }
 
@@ -86,6 +86,8 @@
 #include <assert.h>
 #include <inttypes.h>
 
+#include "fwmap.h"
+
 /*
  * JCG Firmware image header
  */
@@ -133,22 +135,16 @@ struct uimage_header {
 };
 
 /*
- * Open the named file and return its size and file descriptor.
+ * Map the named file and return its size.
  * Exit in case of errors.
  */
-int
-opensize(char *name, size_t *size)
+void
+mapsize(struct fw_map *map, char *name, size_t *size)
 {
-	struct stat s;
-	int fd = open(name, O_RDONLY);
-	if (fd < 0)
+	if (fw_map_file(map, name, 0))
 		err(1, "cannot open \"%s\"", name);
 
-	if (fstat(fd, &s) == -1)
-		err(1, "cannot stat \"%s\"", name);
-
-	*size = s.st_size;
-	return fd;
+	*size = map->size;
 }
 
 static time_t source_date_epoch = -1;
@@ -310,7 +306,8 @@ main(int argc, char **argv)
 	size_t maxsize = MAXSIZE;
 	char *endptr;
 	int mode = MODE_UNKNOWN;
-	int fdo, fd1, fd2;
+	int fdo;
+	struct fw_map map1, map2;
 	size_t size1, size2, sizeu, sizeo, off1, off2;
 	void *map;
 
@@ -371,9 +368,9 @@ main(int argc, char **argv)
 		if (file1 == NULL || file2 == NULL)
 			errx(1, "need -k and -r");
 
-		fd2 = opensize(file2, &size2);
+		mapsize(&map2, file2, &size2);
 	}
-	fd1 = opensize(file1, &size1);
+	mapsize(&map1, file1, &size1);
 	if (mode == MODE_UIMAGE) {
 		off1 = sizeof(*jh);
 		sizeu = size1 + 4;
@@ -403,13 +400,15 @@ main(int argc, char **argv)
 		err(1, "cannot mmap \"%s\"", imagefile);
 
 
-	if (read(fd1, map + off1, size1) != size1)
-		err(1, "cannot copy %s", file1);
+	if (size1)
+		memcpy(map + off1, map1.data, size1);
+	fw_unmap_file(&map1);
 
 
 	if (mode == MODE_KR) {
-		if (read(fd2, map+off2, size2) != size2)
-			err(1, "cannot copy %s", file2);
+		if (size2)
+			memcpy(map + off2, map2.data, size2);
+		fw_unmap_file(&map2);
 
 		mkuheader(uh, size1, size2);
 	} else if (mode == MODE_UIMAGE)
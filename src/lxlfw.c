@@ -18,6 +18,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "fwcopy.h"
+#include "fwread.h"
+
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define cpu_to_le32(x)	bswap_32(x)
 #define cpu_to_le16(x)	bswap_16(x)
@@ -101,9 +104,10 @@ static uint32_t lxlfw_hdr_len(uint32_t version)
  * lxlfw_open - open Luxul firmware file and validate it
  *
  * @pathname: Luxul firmware file
+ * @mode: fopen() mode
  * @hdr: struct to read to
  */
-static FILE *lxlfw_open(const char *pathname, struct lxl_hdr *hdr)
+static FILE *lxlfw_open(const char *pathname, const char *mode, struct lxl_hdr *hdr)
 {
 	size_t v0_len = lxlfw_hdr_len(0);
 	size_t min_hdr_len;
@@ -112,7 +116,7 @@ static FILE *lxlfw_open(const char *pathname, struct lxl_hdr *hdr)
 	size_t bytes;
 	FILE *lxl;
 
-	lxl = fopen(pathname, "r");
+	lxl = fopen(pathname, mode);
 	if (!lxl) {
 		fprintf(stderr, "Could not open \"%s\" file\n", pathname);
 		goto err_out;
@@ -173,23 +177,19 @@ err_out:
 static ssize_t lxlfw_copy_data(FILE *from, FILE *to, size_t size)
 {
 	int copy_all = size == 0;
-	char buf[512];
-	size_t ret = 0;
-
-	while (copy_all || size) {
-		size_t to_read = copy_all ? sizeof(buf) : min(size, sizeof(buf));
-		size_t bytes;
+	struct fw_reader *rd;
+	const uint8_t *buf;
+	ssize_t ret = 0;
+	size_t bytes;
 
-		bytes = fread(buf, 1, to_read, from);
-		if (bytes == 0 && copy_all) {
-			break;
-		} else if (bytes <= 0) {
-			fprintf(stderr, "Failed to read data\n");
-			return -EIO;
-		}
+	rd = fw_reader_open(from, copy_all ? FW_READ_ALL : size);
+	if (!rd)
+		return -ENOMEM;
 
+	while ((bytes = fw_reader_next(rd, &buf)) > 0) {
 		if (fwrite(buf, 1, bytes, to) != bytes) {
 			fprintf(stderr, "Failed to write data\n");
+			fw_reader_close(rd);
 			return -EIO;
 		}
 
@@ -198,6 +198,11 @@ static ssize_t lxlfw_copy_data(FILE *from, FILE *to, size_t size)
 		ret += bytes;
 	}
 
+	if (fw_reader_close(rd) || size) {
+		fprintf(stderr, "Failed to read data\n");
+		return -EIO;
+	}
+
 	return ret;
 }
 
@@ -214,7 +219,8 @@ static ssize_t lxlfw_write_blob(FILE *lxl, uint16_t type, const char *pathname)
 		.magic = { 'D', '#' },
 		.type = cpu_to_le16(type),
 	};
-	char buf[512];
+	struct fw_reader *rd;
+	const uint8_t *buf;
 	size_t blob_data_len;
 	size_t bytes;
 	FILE *data;
@@ -225,17 +231,25 @@ static ssize_t lxlfw_write_blob(FILE *lxl, uint16_t type, const char *pathname)
 		return -EIO;
 	}
 
+	rd = fw_reader_open(data, FW_READ_ALL);
+	if (!rd) {
+		fclose(data);
+		return -ENOMEM;
+	}
+
 	blob_data_len = 0;
 	fseek(lxl, sizeof(blob), SEEK_CUR);
-	while ((bytes = fread(buf, 1, sizeof(buf), data)) > 0) {
+	while ((bytes = fw_reader_next(rd, &buf)) > 0) {
 		if (fwrite(buf, 1, bytes, lxl) != bytes) {
 			fprintf(stderr, "Could not copy %zu bytes from input file\n", bytes);
+			fw_reader_close(rd);
 			fclose(data);
 			return -EIO;
 		}
 		blob_data_len += bytes;
 	}
 
+	fw_reader_close(rd);
 	fclose(data);
 
 	blob.len = cpu_to_le32(blob_data_len);
@@ -270,7 +284,7 @@ static int lxlfw_info(int argc, char **argv) {
 		goto out;
 	}
 
-	lxl = lxlfw_open(argv[2], &hdr);
+	lxl = lxlfw_open(argv[2], "r", &hdr);
 	if (!lxl) {
 		fprintf(stderr, "Could not open \"%s\" Luxul firmware\n", argv[2]);
 		err = -ENOENT;
@@ -379,7 +393,7 @@ static int lxlfw_extract(int argc, char **argv) {
 		goto out;
 	}
 
-	lxl = lxlfw_open(argv[2], &hdr);
+	lxl = lxlfw_open(argv[2], "r", &hdr);
 	if (!lxl) {
 		fprintf(stderr, "Failed to open \"%s\" Luxul firmware\n", argv[2]);
 		err = -ENOENT;
@@ -428,7 +442,8 @@ out:
  * @path: external file pathname to write
  */
 static int lxlfw_blob_save(FILE *lxl, size_t len, const char *path) {
-	char buf[256];
+	struct fw_reader *rd;
+	const uint8_t *buf;
 	size_t bytes;
 	FILE *out;
 	int err = 0;
@@ -440,15 +455,25 @@ static int lxlfw_blob_save(FILE *lxl, size_t len, const char *path) {
 		goto err_out;
 	}
 
-	while (len && (bytes = fread(buf, 1, min(len, sizeof(buf)), lxl)) > 0) {
+	rd = fw_reader_open(lxl, len);
+	if (!rd) {
+		err = -ENOMEM;
+		goto err_close_out;
+	}
+
+	while ((bytes = fw_reader_next(rd, &buf)) > 0) {
 		if (fwrite(buf, 1, bytes, out) != bytes) {
 			fprintf(stderr, "Could not copy %zu bytes from input file\n", bytes);
 			err = -EIO;
-			goto err_close_out;
+			break;
 		}
 		len -= bytes;
 	}
 
+	fw_reader_close(rd);
+	if (err)
+		goto err_close_out;
+
 	if (len) {
 		fprintf(stderr, "Could not copy all signature\n");
 		err = -EIO;
@@ -496,7 +521,7 @@ static int lxlfw_blobs(int argc, char **argv) {
 		goto out;
 	}
 
-	lxl = lxlfw_open(argv[2], &hdr);
+	lxl = lxlfw_open(argv[2], "r", &hdr);
 	if (!lxl) {
 		fprintf(stderr, "Failed to open \"%s\" Luxul firmware\n", argv[2]);
 		err = -ENOENT;
@@ -692,9 +717,9 @@ static int lxlfw_create(int argc, char **argv) {
 	/* Write input data */
 
 	fseek(lxl, 0, SEEK_END);
-	bytes = lxlfw_copy_data(in, lxl, 0);
+	bytes = fw_copy_stream(in, lxl);
 	if (bytes < 0) {
-		fprintf(stderr, "Could not copy %zu bytes from input file\n", bytes);
+		fprintf(stderr, "Could not copy input file\n");
 		err = -EIO;
 		goto err_close_lxl;
 	}
@@ -752,7 +777,7 @@ static int lxlfw_insert(int argc, char **argv) {
 		goto out;
 	}
 
-	lxl = lxlfw_open(argv[2], &hdr);
+	lxl = lxlfw_open(argv[2], "r", &hdr);
 	if (!lxl) {
 		fprintf(stderr, "Failed to open \"%s\" Luxul firmware\n", argv[2]);
 		err = -ENOENT;
@@ -909,6 +934,91 @@ out:
 	return err;
 }
 
+/**************************************************
+ * Edit
+ **************************************************/
+
+static int lxlfw_edit(int argc, char **argv) {
+	struct lxl_hdr hdr = { };
+	uint32_t version;
+	uint32_t hdr_raw_len;
+	ssize_t bytes;
+	FILE *lxl;
+	int c;
+	int err = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "Missing <file> argument\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	lxl = lxlfw_open(argv[2], "r+", &hdr);
+	if (!lxl) {
+		fprintf(stderr, "Failed to open \"%s\" Luxul firmware\n", argv[2]);
+		err = -ENOENT;
+		goto out;
+	}
+
+	version = le32_to_cpu(hdr.version);
+	if (version > MAX_SUPPORTED_VERSION) {
+		fprintf(stderr, "Unsupported <file> version %d\n", version);
+		err = -EIO;
+		goto err_close_lxl;
+	}
+
+	/*
+	 * Header isn't covered by any checksum, so fields can be simply
+	 * overwritten. Only fields present in the current version fit in
+	 * place; adding new ones requires the "insert"-like rewrite.
+	 */
+	optind = 3;
+	while ((c = getopt(argc, argv, "lLb:r:")) != -1) {
+		uint32_t needed = (c == 'r') ? 2 : 1;
+
+		if (version < needed) {
+			fprintf(stderr, "Header version %d has no room for -%c (needs %d)\n", version, c, needed);
+			err = -EINVAL;
+			goto err_close_lxl;
+		}
+
+		switch (c) {
+		case 'l':
+			hdr.flags |= cpu_to_le32(LXL_FLAGS_VENDOR_LUXUL);
+			break;
+		case 'L':
+			hdr.flags &= ~cpu_to_le32(LXL_FLAGS_VENDOR_LUXUL);
+			break;
+		case 'b':
+			memset(hdr.board, 0, sizeof(hdr.board));
+			memcpy(hdr.board, optarg, min(strlen(optarg), sizeof(hdr.board)));
+			break;
+		case 'r':
+			memset(hdr.release, 0, sizeof(hdr.release));
+			if (sscanf(optarg, "%hhu.%hhu.%hhu.%hhu", &hdr.release[0], &hdr.release[1], &hdr.release[2], &hdr.release[3]) < 1) {
+				fprintf(stderr, "Failed to parse release number \"%s\"\n", optarg);
+				err = -EINVAL;
+				goto err_close_lxl;
+			}
+			break;
+		}
+	}
+
+	hdr_raw_len = lxlfw_hdr_len(version);
+
+	fseek(lxl, 0, SEEK_SET);
+	bytes = fwrite(&hdr, 1, hdr_raw_len, lxl);
+	if (bytes != hdr_raw_len) {
+		fprintf(stderr, "Could not write Luxul's header\n");
+		err = -EIO;
+	}
+
+err_close_lxl:
+	fclose(lxl);
+out:
+	return err;
+}
+
 /**************************************************
  * Start
  **************************************************/
@@ -941,6 +1051,13 @@ static void usage() {
 	printf("\tlxlfw insert <file> [options]\n");
 	printf("\t-c file\t\t\t\tcertificate file\n");
 	printf("\t-s file\t\t\t\tsignature file\n");
+	printf("\n");
+	printf("Edit Luxul firmware header in place:\n");
+	printf("\tlxlfw edit <file> [options]\n");
+	printf("\t-l\t\t\t\tset VENDOR_LUXUL flag\n");
+	printf("\t-L\t\t\t\tclear VENDOR_LUXUL flag\n");
+	printf("\t-b board\t\t\tboard (device) name\n");
+	printf("\t-r release\t\t\trelease number (e.g. 5.1.0, 7.1.0.2)\n");
 
 }
 
@@ -956,6 +1073,8 @@ int main(int argc, char **argv) {
 			return lxlfw_create(argc, argv);
 		else if (!strcmp(argv[1], "insert"))
 			return lxlfw_insert(argc, argv);
+		else if (!strcmp(argv[1], "edit"))
+			return lxlfw_edit(argc, argv);
 	}
 
 	usage();
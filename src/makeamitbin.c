@@ -11,6 +11,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "csum.h"
+#include "fwmap.h"
+
 
 /* defaults: Level One WAP-0007 */
 static char *ascii1 = "DDC_RUS001";
@@ -109,23 +112,17 @@ a76e cec8
 
 unsigned short checksum(unsigned char *data, long size)
 {
-	long n;
-	unsigned short d, cs = 0;
-	for (n = 0; n < size; n += 2)
-	{
-		d = READ_SHORT(data, n);
-		cs += d;
-		if (cs < d)
-			cs++;
-	}
+	uint64_t sum = csum_add16_le(0, data, size);
+
+	/*
+	 * Same odd tail as the original loop: the last byte is the low half
+	 * of a word padded with zero, and the byte after that padding, which
+	 * was added once more, is zero as well.  The original read both pad
+	 * bytes past the end of its buffer, where they were always zero.
+	 */
 	if (size & 1)
-	{
-		d = data[n];
-		cs += d;
-		if (cs < d)
-			cs++;
-	}
-	return cs;
+		sum += data[size - 1];
+	return csum_fold16(sum);
 }
 
 void showhdr(unsigned char *hdr)
@@ -169,38 +166,6 @@ void makehdr(unsigned char *hdr, struct hdrinfo *info,
 	COPY_SHORT(hdr, 0x4e, ~checksum(hdr, HDRSIZE));
 }
 
-unsigned char *read_file(const char *name, long *size)
-{
-	FILE *f;
-	unsigned char *data = NULL;
-	*size = 0;
-	f = fopen(name, "r");
-	if (f != NULL)
-	{
-		if (fseek(f, 0, SEEK_END) == 0)
-		{
-	    *size = ftell(f);
-			if (*size != -1)
-			{
-				if (fseek(f, 0, SEEK_SET) == 0)
-				{
-					data = (unsigned char *)malloc(*size);
-					if (data != NULL)
-					{
-						if (fread(data, sizeof(char), *size, f) != *size)
-						{
-							free(data);
-							data = NULL;
-						}
-					}
-				}
-			}
-		}
-		fclose(f);
-	}
-	return data;
-}
-
 struct hdrinfo *find_hdrinfo(const char *name)
 {
 	int n;
@@ -248,6 +213,7 @@ int main(int argc, char *argv[])
 {
 	unsigned char hdr[HDRSIZE];
 	unsigned char *data;
+	struct fw_map map;
 	FILE *of;
 	char *outfile = NULL;
 	char *type;
@@ -282,16 +248,17 @@ int main(int argc, char *argv[])
 			info = find_hdrinfo(type);
 			if (info == NULL)
 				showhelp();
-			data = read_file(argv[n], &size);
-			if (data == NULL)
+			if (fw_map_file(&map, argv[n], 0))
 				showhelp();
+			data = map.data;
+			size = map.size;
 			makehdr(hdr, info, data, size, last);
 			/* showhdr(hdr); */
 			if (fwrite(hdr, HDRSIZE, 1, of) != 1)
 				oferror(of);
 			if (fwrite(data, size, 1, of) != 1)
 				oferror(of);
-			free(data);
+			fw_unmap_file(&map);
 		}
 		else
 			n++;
@@ -16,6 +16,9 @@
 #include <netinet/in.h>
 #include <inttypes.h>
 
+#include "crc32.h"
+#include "fwcopy.h"
+
 #define BPB 8 /* bits/byte */
 
 static uint32_t crc32[1<<BPB];
@@ -23,7 +26,9 @@ static uint32_t crc32[1<<BPB];
 static char *output_file = "default-brnImage";
 static uint32_t magic = 0x12345678;
 static char *signature = "BRNDTW502";
-static uint32_t crc32_poly = 0x2083b8ed;
+#define CRC32_POLY_DEFAULT 0x2083b8ed
+
+static uint32_t crc32_poly = CRC32_POLY_DEFAULT;
 
 static void init_crc32()
 {
@@ -45,6 +50,10 @@ static uint32_t crc32buf(const void *buf, size_t len)
 	uint32_t crc = 0xFFFFFFFF;
 	const uint8_t *in = buf;
 
+	/* the IEEE polynomial uses the shared constant tables */
+	if (crc32_poly == CRC32_POLY_DEFAULT)
+		return ~crc32_le_update(crc, buf, len);
+
 	for (; len; len--, in++)
 		crc = crc32[(uint8_t)crc ^ *in] ^ (crc >> BPB);
 	return ~crc;
@@ -105,8 +114,7 @@ static void appendfile(int outfd, char *path, int kernel) {
 	// mmap input_file
 	if ((fd = open(path, O_RDONLY))  < 0
 	|| (len = lseek(fd, 0, SEEK_END)) < 0
-	|| (input_file = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0)) == (void *) (-1)
-	|| close(fd) < 0)
+	|| (input_file = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0)) == (void *) (-1))
 	{
 		fprintf(stderr, "Error mapping file '%s': %s\n", path, strerror(errno));
 		exit(1);
@@ -122,12 +130,16 @@ static void appendfile(int outfd, char *path, int kernel) {
 		exit(1);
 	}
 
-	init_crc32();
 	crc = crc32buf(input_file, len);
 	fprintf(stderr, "crc32 for '%s' is %08x.\n", path, crc);
 
-	// write the file
-	write(outfd, input_file, len);
+	// write the file, sharing its blocks with the output where possible
+	if (fw_copy_range(fd, 0, outfd, lseek(outfd, 0, SEEK_CUR), len) < 0
+	|| lseek(outfd, len, SEEK_CUR) < 0)
+	{
+		fprintf(stderr, "Error copying file '%s': %s\n", path, strerror(errno));
+		exit(1);
+	}
 
 	// write padding
 	padded_len = ((len + sizeof(footer) + sizeof(padding) - 1) & ~(sizeof(padding) - 1)) - sizeof(footer);
@@ -150,6 +162,7 @@ static void appendfile(int outfd, char *path, int kernel) {
 	write(outfd, footer, sizeof(footer));
 
 	munmap(input_file, len);
+	close(fd);
 }
 
 int main(int argc, char **argv)
@@ -162,6 +175,9 @@ int main(int argc, char **argv)
 	if (argc < 1)
 		usage("wrong number of arguments");
 
+	if (crc32_poly != CRC32_POLY_DEFAULT)
+		init_crc32();
+
 	if ((outfd = open(output_file, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
 	{
 		fprintf(stderr, "Error opening '%s' for writing: %s\n", output_file, strerror(errno));
@@ -17,6 +17,8 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include "csum.h"
+
 #define MAX_MODEL_LEN		20
 #define MAX_SIGNATURE_LEN	30
 #define MAX_REGION_LEN		4
@@ -282,12 +284,7 @@ out:
 
 static uint32_t get_csum(unsigned char *p, uint32_t len)
 {
-	uint32_t csum = 0;
-
-	while (len--)
-		csum += *p++;
-
-	return csum;
+	return csum_add8(0, p, len);
 }
 
 static int build_fw(void)
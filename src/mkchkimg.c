@@ -17,6 +17,7 @@
 #define BUF_LEN (2048)
 
 #define MAX_BOARD_ID_LEN (64)
+#define MAX_OUTPUTS (32)
 
 /*
  * Note on the reserved field of the chk_header:
@@ -45,6 +46,17 @@ struct chk_header {
 	/* char board_id[] - upto MAX_BOARD_ID_LEN */
 };
 
+/*
+ * One output image. The data and its checksums are the same for all of
+ * them, only the header (board id and region) differs.
+ */
+struct chk_output {
+	char * file;
+	char * board_id;
+	unsigned long region;
+	FILE * fp;
+};
+
 static void __attribute__ ((format (printf, 2, 3)))
 fatal_error (int maybe_errno, const char * format, ...)
 {
@@ -115,20 +127,106 @@ static void
 print_help (void)
 {
 	fprintf (stderr, "Usage: mkchkimg -o output -k kernel [-f filesys] [-b board_id] [-r region]\n");
+	fprintf (stderr, "       [-V board_id:region:output ...]\n");
+}
+
+static unsigned long
+parse_region (const char * arg)
+{
+	unsigned long region;
+	char * ptr;
+
+	errno = 0;
+	region = strtoul (arg, &ptr, 0);
+	if (errno || ptr==arg || *ptr!='\0') {
+		fatal_error (0, "Cannot parse region %s", arg);
+	}
+	if (region > 0xff) {
+		fatal_error (0, "Region cannot exceed 0xff");
+	}
+	return region;
+}
+
+static void
+parse_variant (char * arg, struct chk_output * o)
+{
+	char * region, * file;
+
+	region = strchr (arg, ':');
+	file = region ? strchr (region + 1, ':') : NULL;
+	if (!file || !file[1]) {
+		fatal_error (0, "Variant %s is not board_id:region:output", arg);
+	}
+	*region++ = '\0';
+	*file++ = '\0';
+
+	if (strlen (arg) > MAX_BOARD_ID_LEN) {
+		fatal_error (0, "Board lenght exceeds %d", MAX_BOARD_ID_LEN);
+	}
+	o->board_id = arg;
+	o->region = parse_region (region);
+	o->file = file;
+}
+
+static void
+write_data (struct chk_output * outputs, int num_outputs, char * buf,
+	    size_t len)
+{
+	int i;
+
+	for (i = 0; i < num_outputs; i++) {
+		if (fwrite (buf, len, 1, outputs[i].fp) != 1) {
+			fatal_error (errno, "Write error");
+		}
+	}
+}
+
+/* Finish the header of one output and write it in front of the data */
+static void
+write_header (struct chk_output * o, const struct chk_header * data_hdr)
+{
+	struct chk_header hdr = *data_hdr;
+	struct ngr_checksum chk;
+	size_t header_len = sizeof (struct chk_header) + strlen (o->board_id);
+
+	/* Fill in known values */
+	hdr.magic = htonl (0x2a23245e);
+	hdr.header_len = htonl(header_len);
+	hdr.reserved[0] = (unsigned char)(o->region & 0xff);
+	memset(&hdr.reserved[1], 99, sizeof(hdr.reserved) - 1);
+
+	/* Calculate the header checksum */
+	netgear_checksum_init (&chk);
+	netgear_checksum_add (&chk, (unsigned char *)&hdr,
+				sizeof (struct chk_header));
+	netgear_checksum_add (&chk, (unsigned char *)o->board_id,
+				strlen (o->board_id));
+	hdr.header_chksum = htonl (netgear_checksum_fini (&chk));
+
+	/* Finally rewind the output and write headers */
+	rewind (o->fp);
+	if (fwrite (&hdr, sizeof (struct chk_header), 1, o->fp) != 1) {
+		fatal_error (errno, "Cannot write header");
+	}
+	if (fwrite (o->board_id, strlen (o->board_id), 1, o->fp) != 1) {
+		fatal_error (errno, "Cannot write board id");
+	}
+
+	fclose(o->fp);
 }
 
 int
 main (int argc, char * argv[])
 {
 	int opt;
-	char * ptr;
 	size_t len;
-	size_t header_len;
-	struct chk_header * hdr;
+	int i, num_outputs;
+	struct chk_header hdr;
+	struct chk_output outputs[MAX_OUTPUTS];
 	struct ngr_checksum chk_part, chk_whole;
 	char buf[BUF_LEN];
 	char * output_file, * kern_file, * fs_file;
-	FILE * out_fp, * kern_fp, * fs_fp;
+	FILE * kern_fp, * fs_fp;
 	char * board_id;
 	unsigned long region;
 
@@ -139,8 +237,9 @@ main (int argc, char * argv[])
 	kern_file = NULL;
 	fs_file = NULL;
 	fs_fp = NULL;
+	num_outputs = 0;
 
-	while ((opt = getopt (argc, argv, ":b:r:k:f:o:h")) != -1) {
+	while ((opt = getopt (argc, argv, ":b:r:k:f:o:V:h")) != -1) {
 		switch (opt) {
 		    case 'b':
 		    	/* Board Identity */
@@ -153,14 +252,7 @@ main (int argc, char * argv[])
 
 		    case 'r':
 		    	/* Region */
-			errno = 0;
-			region = strtoul (optarg, &ptr, 0);
-			if (errno || ptr==optarg || *ptr!='\0') {
-				fatal_error (0, "Cannot parse region %s", optarg);
-			}
-			if (region > 0xff) {
-				fatal_error (0, "Region cannot exceed 0xff");
-			}
+			region = parse_region (optarg);
 			break;
 
 		    case 'k':
@@ -178,6 +270,14 @@ main (int argc, char * argv[])
 			output_file = optarg;
 			break;
 
+		    case 'V':
+		    	/* Additional board variant, shares the data pass */
+			if (num_outputs == MAX_OUTPUTS - 1) {
+				fatal_error (0, "Too many variants");
+			}
+			parse_variant (optarg, &outputs[num_outputs++]);
+			break;
+
 		    case 'h':
 		    	print_help ();
 			return EXIT_SUCCESS;
@@ -202,12 +302,21 @@ main (int argc, char * argv[])
 		print_help ();
 		fatal_error (0, "Kernel file expected");
 	}
-	if (!output_file) {
+	if (!output_file && !num_outputs) {
 		print_help ();
 		fatal_error (0, "Output file required");
 	}
 	message ("Netgear CHK writer - v0.1");
 
+	/* The plain -o output goes first */
+	if (output_file) {
+		memmove (&outputs[1], &outputs[0], num_outputs * sizeof (outputs[0]));
+		outputs[0].file = output_file;
+		outputs[0].board_id = board_id;
+		outputs[0].region = region;
+		num_outputs++;
+	}
+
 	/* Open the input file */
 	kern_fp = fopen (kern_file, "r");
 	if (!kern_fp) {
@@ -223,39 +332,29 @@ main (int argc, char * argv[])
 		}
 	}
 
-	/* Open the output file */
-	out_fp = fopen (output_file, "w+");
-	if (!out_fp) {
-		fclose(kern_fp);
-		if (fs_fp) {
-			fclose(fs_fp);
+	/* Open the output files */
+	memset (buf, 0, sizeof (struct chk_header) + MAX_BOARD_ID_LEN);
+	for (i = 0; i < num_outputs; i++) {
+		struct chk_output * o = &outputs[i];
+		size_t header_len = sizeof (struct chk_header) + strlen (o->board_id);
+
+		o->fp = fopen (o->file, "w+");
+		if (!o->fp) {
+			fatal_error (errno, "Cannot open %s", o->file);
 		}
-		fatal_error (errno, "Cannot open %s", output_file);
-	}
 
-	/* Write zeros when the chk header will be */
-	buf[0] = '\0';
-	header_len = sizeof (struct chk_header) + strlen (board_id);
-	if (fwrite (buf, 1, header_len, out_fp) != header_len) {
-		fatal_error (errno, "Cannot write header");
-	}
+		/* Write zeros when the chk header will be */
+		if (fwrite (buf, 1, header_len, o->fp) != header_len) {
+			fatal_error (errno, "Cannot write header");
+		}
 
-	/* Allocate storage for header, we fill in as we go */
-	hdr = malloc (sizeof (struct chk_header));
-	if (!hdr) {
-		fatal_error (0, "malloc failed");
+		message ("       Board Id: %s", o->board_id);
+		message ("         Region: %s", o->region == 1 ? "World Wide (WW)" 
+				: (o->region == 2 ? "North America (NA)" : "Unknown"));
 	}
-	bzero (hdr, sizeof (struct chk_header));
 
-	/* Fill in known values */
-	hdr->magic = htonl (0x2a23245e);
-	hdr->header_len = htonl(header_len);
-	hdr->reserved[0] = (unsigned char)(region & 0xff);
-	memset(&hdr->reserved[1], 99, sizeof(hdr->reserved) - 1);
-
-	message ("       Board Id: %s", board_id);
-	message ("         Region: %s", region == 1 ? "World Wide (WW)" 
-			: (region == 2 ? "North America (NA)" : "Unknown"));
+	/* Header fields depending on the data only, we fill in as we go */
+	memset (&hdr, 0, sizeof (hdr));
 
 	/* Copy the trx file, calculating the checksum as we go */
 	netgear_checksum_init (&chk_part);
@@ -265,19 +364,17 @@ main (int argc, char * argv[])
 		if (len < 1) {
 			break;
 		}
-		if (fwrite (buf, len, 1, out_fp) != 1) {
-			fatal_error (errno, "Write error");
-		}
-		hdr->kernel_len += len;
+		write_data (outputs, num_outputs, buf, len);
+		hdr.kernel_len += len;
 		netgear_checksum_add (&chk_part, (unsigned char *)buf, len);
 		netgear_checksum_add (&chk_whole, (unsigned char *)buf, len);
 	}
 	fclose(kern_fp);
-	hdr->kernel_chksum = netgear_checksum_fini (&chk_part);
-	message ("     Kernel Len: %u", hdr->kernel_len);
-	message ("Kernel Checksum: 0x%08x", hdr->kernel_chksum);
-	hdr->kernel_len = htonl (hdr->kernel_len);
-	hdr->kernel_chksum = htonl (hdr->kernel_chksum);
+	hdr.kernel_chksum = netgear_checksum_fini (&chk_part);
+	message ("     Kernel Len: %u", hdr.kernel_len);
+	message ("Kernel Checksum: 0x%08x", hdr.kernel_chksum);
+	hdr.kernel_len = htonl (hdr.kernel_len);
+	hdr.kernel_chksum = htonl (hdr.kernel_chksum);
 
 	/* Now copy the root fs, calculating the checksum as we go */
 	if (fs_fp) {
@@ -287,45 +384,29 @@ main (int argc, char * argv[])
 			if (len < 1) {
 				break;
 			}
-			if (fwrite (buf, len, 1, out_fp) != 1) {
-				fatal_error (errno, "Write error");
-			}
-			hdr->rootfs_len += len;
+			write_data (outputs, num_outputs, buf, len);
+			hdr.rootfs_len += len;
 			netgear_checksum_add (&chk_part, (unsigned char *)buf, len);
 			netgear_checksum_add (&chk_whole, (unsigned char *)buf, len);
 		}
 		fclose(fs_fp);
-		hdr->rootfs_chksum = (netgear_checksum_fini (&chk_part));
-		message ("     Rootfs Len: %u", hdr->rootfs_len);
-		message ("Rootfs Checksum: 0x%08x", hdr->rootfs_chksum);
-		hdr->rootfs_len = htonl (hdr->rootfs_len);
-		hdr->rootfs_chksum = htonl (hdr->rootfs_chksum);
+		hdr.rootfs_chksum = (netgear_checksum_fini (&chk_part));
+		message ("     Rootfs Len: %u", hdr.rootfs_len);
+		message ("Rootfs Checksum: 0x%08x", hdr.rootfs_chksum);
+		hdr.rootfs_len = htonl (hdr.rootfs_len);
+		hdr.rootfs_chksum = htonl (hdr.rootfs_chksum);
 	}
 
 	/* Calcautate the image checksum */
-	hdr->image_chksum = netgear_checksum_fini (&chk_whole);
-	message (" Image Checksum: 0x%08x", hdr->image_chksum);
-	hdr->image_chksum = htonl (hdr->image_chksum);
+	hdr.image_chksum = netgear_checksum_fini (&chk_whole);
+	message (" Image Checksum: 0x%08x", hdr.image_chksum);
+	hdr.image_chksum = htonl (hdr.image_chksum);
 
-	/* Calculate the header checksum */
-	netgear_checksum_init (&chk_part);
-	netgear_checksum_add (&chk_part, (unsigned char *)hdr, 
-				sizeof (struct chk_header));
-	netgear_checksum_add (&chk_part, (unsigned char *)board_id,
-				strlen (board_id));
-	hdr->header_chksum = htonl (netgear_checksum_fini (&chk_part));
-
-	/* Finally rewind the output and write headers */
-	rewind (out_fp);
-	if (fwrite (hdr, sizeof (struct chk_header), 1, out_fp) != 1) {
-		fatal_error (errno, "Cannot write header");
-	}
-	if (fwrite (board_id, strlen (board_id), 1, out_fp) != 1) {
-		fatal_error (errno, "Cannot write board id");
+	/* The data checksums hold for every variant, only headers differ */
+	for (i = 0; i < num_outputs; i++) {
+		write_header (&outputs[i], &hdr);
 	}
 
 	/* Success */
-	fclose(out_fp);
 	return EXIT_SUCCESS;
 }
-
@@ -9,6 +9,8 @@
  * Copyright (C) 2008,2009 Wang Jian <lark@linux.net.cn>
  */
 
+#define _DEFAULT_SOURCE /* madvise */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -21,9 +23,13 @@
 #include <endian.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <zlib.h>		/*for crc32 */
 
+#include "csum.h"
 #include "mkdlinkfw-lib.h"
 
 extern char *progname;
@@ -50,20 +56,48 @@ uint32_t jboot_timestamp(void)
 	return (((uint32_t) fixed_timestamp) - TIMESTAMP_MAGIC) >> 2;
 }
 
-uint16_t jboot_checksum(uint16_t start_val, uint16_t *data, int size)
+void jboot_csum_init(struct jboot_csum *csum, uint16_t start_val)
+{
+	csum->sum = start_val;
+	csum->odd = false;
+}
+
+void jboot_csum_update(struct jboot_csum *csum, const void *data, size_t len)
 {
-	uint32_t counter = start_val;
-	uint16_t *ptr = data;
-
-	while (size > 1) {
-		counter += *ptr;
-		++ptr;
-		while (counter >> 16)
-			counter = (uint16_t) counter + (counter >> 16);
-		size -= 2;
+	const uint8_t *p = data;
+
+	if (!len)
+		return;
+
+	/* pair up the byte left over from the previous chunk */
+	if (csum->odd) {
+		uint8_t word[2] = { csum->odd_byte, p[0] };
+
+		csum->sum = csum_add16(csum->sum, word, 2);
+		csum->odd = false;
+		p++;
+		len--;
 	}
-	if (size > 0) {
-		counter += *(uint8_t *) ptr;
+
+	csum->sum = csum_add16(csum->sum, p, len & ~1);
+	if (len & 1) {
+		csum->odd_byte = p[len - 1];
+		csum->odd = true;
+	}
+}
+
+uint16_t jboot_csum_final(const struct jboot_csum *csum)
+{
+	uint32_t counter;
+
+	/*
+	 * Folding the carry once at the end yields the same 16-bit value as
+	 * folding it after every word, so the even part is summed in wide
+	 * lanes.  The odd tail keeps the bootloader's "- 0xFF" quirk.
+	 */
+	counter = csum_fold16(csum->sum);
+	if (csum->odd) {
+		counter += csum->odd_byte;
 		counter -= 0xFF;
 	}
 	while (counter >> 16)
@@ -71,6 +105,16 @@ uint16_t jboot_checksum(uint16_t start_val, uint16_t *data, int size)
 	return counter;
 }
 
+uint16_t jboot_checksum(uint16_t start_val, uint16_t *data, int size)
+{
+	struct jboot_csum csum;
+
+	jboot_csum_init(&csum, start_val);
+	if (size > 0)
+		jboot_csum_update(&csum, data, size);
+	return jboot_csum_final(&csum);
+}
+
 int get_file_stat(struct file_info *fdata)
 {
 	struct stat st;
@@ -115,31 +159,81 @@ int read_to_buf(const struct file_info *fdata, char *buf)
 	return ret;
 }
 
-int write_fw(const char *ofname, const char *data, int len)
+char *map_file(const struct file_info *fdata)
 {
-	FILE *f;
+	static char empty[1];
+	char *data;
+	int fd;
+
+	if (!fdata->file_size)
+		return empty;
+
+	fd = open(fdata->file_name, O_RDONLY);
+	if (fd < 0) {
+		ERRS("could not open \"%s\" for reading", fdata->file_name);
+		return NULL;
+	}
+
+	data = mmap(NULL, fdata->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		ERRS("unable to map file \"%s\"", fdata->file_name);
+		return NULL;
+	}
+
+	madvise(data, fdata->file_size, MADV_SEQUENTIAL);
+
+	return data;
+}
+
+void unmap_file(const struct file_info *fdata, char *data)
+{
+	if (data && fdata->file_size)
+		munmap(data, fdata->file_size);
+}
+
+int write_fw(const char *ofname, const struct iovec *iov, int iovcnt)
+{
+	struct iovec vec[iovcnt];
+	struct iovec *v = vec;
 	int ret = EXIT_FAILURE;
+	int fd;
 
-	f = fopen(ofname, "w");
-	if (f == NULL) {
+	memcpy(vec, iov, sizeof(vec));
+
+	fd = open(ofname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
 		ERRS("could not open \"%s\" for writing", ofname);
 		goto out;
 	}
 
-	errno = 0;
-	fwrite(data, len, 1, f);
-	if (errno) {
-		ERRS("unable to write output file");
-		goto out_flush;
+	while (iovcnt) {
+		ssize_t n = writev(fd, v, iovcnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ERRS("unable to write output file");
+			goto out_close;
+		}
+
+		while (iovcnt && (size_t) n >= v->iov_len) {
+			n -= v->iov_len;
+			v++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			v->iov_base = (char *)v->iov_base + n;
+			v->iov_len -= n;
+		}
 	}
 
 	DBG("firmware file \"%s\" completed", ofname);
 
 	ret = EXIT_SUCCESS;
 
- out_flush:
-	fflush(f);
-	fclose(f);
+ out_close:
+	close(fd);
 	if (ret != EXIT_SUCCESS)
 		unlink(ofname);
  out:
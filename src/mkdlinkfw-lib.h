@@ -12,6 +12,11 @@
 #ifndef mkdlinkfw_lib_h
 #define mkdlinkfw_lib_h
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
 #define AUH_MAGIC "DLK"
 #define AUH_SIZE 80
 #define AUH_LVPS 0x01
@@ -71,10 +76,22 @@ struct file_info {
 	uint32_t file_size;	/* length of the file */
 };
 
+/* running jboot_checksum over data that is not contiguous in memory */
+struct jboot_csum {
+	uint64_t sum;
+	uint8_t odd_byte;	/* unpaired trailing byte of the data so far */
+	bool odd;
+};
+
 uint32_t jboot_timestamp(void);
+void jboot_csum_init(struct jboot_csum *csum, uint16_t start_val);
+void jboot_csum_update(struct jboot_csum *csum, const void *data, size_t len);
+uint16_t jboot_csum_final(const struct jboot_csum *csum);
 uint16_t jboot_checksum(uint16_t start_val, uint16_t *data, int size);
 int get_file_stat(struct file_info *fdata);
 int read_to_buf(const struct file_info *fdata, char *buf);
-int write_fw(const char *ofname, const char *data, int len);
+char *map_file(const struct file_info *fdata);
+void unmap_file(const struct file_info *fdata, char *data);
+int write_fw(const char *ofname, const struct iovec *iov, int iovcnt);
 
 #endif				/* mkdlinkfw_lib_h */
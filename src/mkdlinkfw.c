@@ -93,6 +93,7 @@ struct file_info rootfs_info;
 struct file_info image_info;
 
 char *ofname;
+char *factory_ofname;
 char *progname;
 uint32_t firmware_size;
 uint32_t image_offset;
@@ -112,6 +113,7 @@ static void usage(int status)
 		"  -k <file>       read kernel image from the file <file>\n"
 		"  -r <file>       read rootfs image from the file <file>\n"
 		"  -o <file>       write output to the file <file>\n"
+		"  -W <file>       also write the image wrapped as FACTORY to <file>\n"
 		"  -s <size>       set firmware partition size\n"
 		"  -m <version>    set rom id to <version> (12-bit string val: \"DLK*********\")\n"
 		"  -h              show this screen\n");
@@ -412,16 +414,22 @@ int fill_sch2(struct sch2_header *header, char *kernel_ptr, char *rootfs_ptr)
 	return EXIT_SUCCESS;
 }
 
-int fill_stag(struct stag_header *header, uint32_t length)
+int fill_stag(struct stag_header *header, const struct sch2_header *sch2,
+	      const char *kernel_ptr, uint32_t length)
 {
+	struct jboot_csum csum;
+
 	header->cmark = STAG_ID;
 	header->id = STAG_ID;
 	header->magic = STAG_MAGIC;
 	header->time_stamp = jboot_timestamp();
 	header->image_length = length + SCH2_SIZE;
-	header->image_checksum =
-	    jboot_checksum(0, (uint16_t *) ((char *)header + STAG_SIZE),
-			   header->image_length);
+
+	jboot_csum_init(&csum, 0);
+	jboot_csum_update(&csum, sch2, SCH2_SIZE);
+	jboot_csum_update(&csum, kernel_ptr, length);
+	header->image_checksum = jboot_csum_final(&csum);
+
 	header->tag_checksum =
 	    ~jboot_checksum(0, (uint16_t *) header, STAG_SIZE - 2);
 
@@ -431,12 +439,12 @@ int fill_stag(struct stag_header *header, uint32_t length)
 	return EXIT_SUCCESS;
 };
 
-int fill_auh(struct auh_header *header, uint32_t length)
+int fill_auh(struct auh_header *header, uint32_t length,
+	     uint16_t image_checksum)
 {
 	memcpy(header->rom_id, rom_id, 12);
 	header->derange = 0;
-	header->image_checksum =
-	    jboot_checksum(0, (uint16_t *) ((char *)header + AUH_SIZE), length);
+	header->image_checksum = image_checksum;
 	header->space1 = 0;
 	header->space2 = 0;
 	header->space3 = 0;
@@ -464,16 +472,55 @@ int fill_auh(struct auh_header *header, uint32_t length)
 	return EXIT_SUCCESS;
 }
 
+static int check_auh_options(void)
+{
+	if (!family_member) {
+		ERR("No family_member!\n");
+		return EXIT_FAILURE;
+	}
+	if (!(rom_id[0])) {
+		ERR("No rom_id!\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Prepend an AUH header to the image made up of iov[1] .. iov[iovcnt - 1]
+ * and write it out; iov[0] is used for the header.
+ */
+static int write_wrapped_fw(const char *name, struct iovec *iov, int iovcnt)
+{
+	struct auh_header auh_header;
+	struct jboot_csum csum;
+	uint32_t length = 0;
+	int i;
+
+	jboot_csum_init(&csum, 0);
+	for (i = 1; i < iovcnt; i++) {
+		jboot_csum_update(&csum, iov[i].iov_base, iov[i].iov_len);
+		length += iov[i].iov_len;
+	}
+
+	memset(&auh_header, 0xff, sizeof(auh_header));
+	fill_auh(&auh_header, length, jboot_csum_final(&csum));
+
+	iov[0].iov_base = &auh_header;
+	iov[0].iov_len = AUH_SIZE;
+
+	return write_fw(name, iov, iovcnt);
+}
+
 int build_fw(void)
 {
-	char *buf;
 	char *kernel_ptr;
 	char *rootfs_ptr;
 	int ret = EXIT_FAILURE;
-	int writelen;
 
-	struct stag_header *stag_header_kernel;
-	struct sch2_header *sch2_header_kernel;
+	struct stag_header stag_header_kernel;
+	struct sch2_header sch2_header_kernel;
+	struct iovec iov[5];
 
 	if (!kernel_info.file_name | !rootfs_info.file_name)
 		goto out;
@@ -485,61 +532,61 @@ int build_fw(void)
 	if (ret)
 		goto out;
 
-	buf = malloc(firmware_size);
-	if (!buf) {
-		ERR("no memory for buffer\n");
-		goto out;
-	}
+	ret = EXIT_FAILURE;
 
 	if (rootfs_info.file_size + kernel_info.file_size + ALL_HEADERS_SIZE >
 	    firmware_size) {
 		ERR("data is bigger than firmware_size!\n");
 		goto out;
 	}
+	if (factory_ofname && check_auh_options())
+		goto out;
 
-	memset(buf, 0xff, firmware_size);
-
-	stag_header_kernel = (struct stag_header *)buf;
-
-	sch2_header_kernel =
-	    (struct sch2_header *)((char *)stag_header_kernel + STAG_SIZE);
-	kernel_ptr = (char *)sch2_header_kernel + SCH2_SIZE;
-
-	ret = read_to_buf(&kernel_info, kernel_ptr);
-	if (ret)
-		goto out_free_buf;
+	kernel_ptr = map_file(&kernel_info);
+	if (!kernel_ptr)
+		goto out;
 
-	rootfs_ptr = kernel_ptr + kernel_info.file_size;
+	rootfs_ptr = map_file(&rootfs_info);
+	if (!rootfs_ptr)
+		goto out_unmap_kernel;
 
-	ret = read_to_buf(&rootfs_info, rootfs_ptr);
-	if (ret)
-		goto out_free_buf;
+	memset(&stag_header_kernel, 0xff, sizeof(stag_header_kernel));
+	memset(&sch2_header_kernel, 0xff, sizeof(sch2_header_kernel));
 
-	writelen = rootfs_ptr + rootfs_info.file_size - buf;
+	fill_sch2(&sch2_header_kernel, kernel_ptr, rootfs_ptr);
+	fill_stag(&stag_header_kernel, &sch2_header_kernel, kernel_ptr,
+		  kernel_info.file_size);
 
-	fill_sch2(sch2_header_kernel, kernel_ptr, rootfs_ptr);
-	fill_stag(stag_header_kernel, kernel_info.file_size);
+	/* iov[0] is reserved for the AUH header of the factory image */
+	iov[1].iov_base = &stag_header_kernel;
+	iov[1].iov_len = STAG_SIZE;
+	iov[2].iov_base = &sch2_header_kernel;
+	iov[2].iov_len = SCH2_SIZE;
+	iov[3].iov_base = kernel_ptr;
+	iov[3].iov_len = kernel_info.file_size;
+	iov[4].iov_base = rootfs_ptr;
+	iov[4].iov_len = rootfs_info.file_size;
 
-	ret = write_fw(ofname, buf, writelen);
+	ret = write_fw(ofname, iov + 1, 4);
 	if (ret)
-		goto out_free_buf;
+		goto out_unmap_rootfs;
 
-	ret = EXIT_SUCCESS;
+	if (factory_ofname)
+		ret = write_wrapped_fw(factory_ofname, iov, 5);
 
- out_free_buf:
-	free(buf);
+ out_unmap_rootfs:
+	unmap_file(&rootfs_info, rootfs_ptr);
+ out_unmap_kernel:
+	unmap_file(&kernel_info, kernel_ptr);
  out:
 	return ret;
 }
 
 int wrap_fw(void)
 {
-	char *buf;
 	char *image_ptr;
 	int ret = EXIT_FAILURE;
-	int writelen;
-
-	struct auh_header *auh_header_kernel;
+	struct iovec iov[2];
 
 	if (!image_info.file_name)
 		goto out;
@@ -548,46 +595,26 @@ int wrap_fw(void)
 	if (ret)
 		goto out;
 
-	buf = malloc(firmware_size);
-	if (!buf) {
-		ERR("no memory for buffer\n");
-		goto out;
-	}
+	ret = EXIT_FAILURE;
 
 	if (image_info.file_size + AUH_SIZE >
 	    firmware_size) {
 		ERR("data is bigger than firmware_size!\n");
 		goto out;
 	}
-	if (!family_member) {
-		ERR("No family_member!\n");
-		goto out;
-	}
-	if (!(rom_id[0])) {
-		ERR("No rom_id!\n");
+	if (check_auh_options())
 		goto out;
-	}
-	memset(buf, 0xff, firmware_size);
-
-	image_ptr = (char *)(buf + AUH_SIZE);
-
-	ret = read_to_buf(&image_info, image_ptr);
-	if (ret)
-		goto out_free_buf;
-
-	writelen = image_ptr + image_info.file_size - buf;
 
-	auh_header_kernel = (struct auh_header *)buf;
-	fill_auh(auh_header_kernel, writelen - AUH_SIZE);
+	image_ptr = map_file(&image_info);
+	if (!image_ptr)
+		goto out;
 
-	ret = write_fw(ofname, buf, writelen);
-	if (ret)
-		goto out_free_buf;
+	iov[1].iov_base = image_ptr;
+	iov[1].iov_len = image_info.file_size;
 
-	ret = EXIT_SUCCESS;
+	ret = write_wrapped_fw(ofname, iov, 2);
 
- out_free_buf:
-	free(buf);
+	unmap_file(&image_info, image_ptr);
  out:
 	return ret;
 }
@@ -605,7 +632,7 @@ int main(int argc, char *argv[])
 	while (1) {
 		int c;
 
-		c = getopt(argc, argv, "f:F:i:hk:m:o:O:r:s:");
+		c = getopt(argc, argv, "f:F:i:hk:m:o:O:r:s:W:");
 		if (c == -1)
 			break;
 
@@ -639,6 +666,9 @@ int main(int argc, char *argv[])
 		case 's':
 			sscanf(optarg, "0x%x", &firmware_size);
 			break;
+		case 'W':
+			factory_ofname = optarg;
+			break;
 		default:
 			usage(EXIT_FAILURE);
 			break;
@@ -13,6 +13,8 @@
 #include <sys/stat.h>
 #include <endian.h>	/* for __BYTE_ORDER */
 
+#include "csum.h"
+
 #define FALSE 0
 #define TRUE 1
 
@@ -85,17 +87,14 @@ static int strtou32(char *arg, unsigned int *val)
 }
 
 static unsigned short fwcsum (struct buf *buf) {
-    int i;
-    unsigned short ret = 0;
-
-    for (i = 0; i < buf->size / 2; i++) {
-	if (force_be == FALSE)
-	    ret -= ((unsigned short *) buf->start)[i];
-	else
-	    ret -= HOST_TO_BE16(((unsigned short *) buf->start)[i]);
-    }
-    
-    return ret;
+    uint64_t sum;
+
+    if (force_be == FALSE)
+	sum = csum_add16(0, buf->start, buf->size);
+    else
+	sum = csum_add16_be(0, buf->start, buf->size);
+
+    return -(unsigned short) sum;
 }
 
 static int fwread(struct finfo *finfo, struct buf *buf)
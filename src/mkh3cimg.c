@@ -10,6 +10,8 @@
 #include <endian.h>
 #include <getopt.h>
 
+#include "fwmap.h"
+
 
 #if !defined(__BYTE_ORDER)
 #error "Unknown byte order"
@@ -116,14 +118,17 @@ struct image_header {
 
 static void *buf;
 static size_t buflen;
+static size_t hdrlen;
+
+static struct fw_map input;
+static const char zero_pad[8];
 
 static size_t length_unpadded;
 static size_t length;
 
 
-static uint32_t crc16_xmodem(char *buf, size_t len) {
+static uint32_t crc16_xmodem_update(uint32_t crc, const char *buf, size_t len) {
 	uint32_t poly = 0x1021;
-	uint32_t crc = 0;
 	char b;
 	int i, j;
 
@@ -142,45 +147,45 @@ static uint32_t crc16_xmodem(char *buf, size_t len) {
 	return crc;
 }
 
-static int create_buffer_and_read_file(char *filename) {
-	FILE *f;
+static uint32_t crc16_xmodem(char *buf, size_t len) {
+	return crc16_xmodem_update(0, buf, len);
+}
 
-	f = fopen(filename, "r");
-	if (f == NULL) {
+/* continue a CRC over the input file and its zero padding */
+static uint32_t crc16_xmodem_payload(uint32_t crc) {
+	crc = crc16_xmodem_update(crc, input.data, length_unpadded);
+	return crc16_xmodem_update(crc, zero_pad, length - length_unpadded);
+}
+
+static int map_input_file(char *filename) {
+	if (fw_map_file(&input, filename, 0)) {
 		fprintf(stderr, "failed to open input file\n");
 		goto err;
 	}
 
-	fseek(f, 0L, SEEK_END);
-	length_unpadded = ftell(f);
-	rewind(f);
+	length_unpadded = input.size;
+	if (!length_unpadded) {
+		fprintf(stderr, "failed to read input file\n");
+		goto err_unmap;
+	}
 
 	length = length_unpadded;
 	if (length_unpadded % 8 != 0) {
 		length += 8 - length_unpadded % 8;
 	}
 
-	buflen = sizeof(struct file_header) + sizeof(struct image_header) + length;
-	buf = malloc(buflen);
+	hdrlen = sizeof(struct file_header) + sizeof(struct image_header);
+	buflen = hdrlen + length;
+	buf = calloc(1, hdrlen);
 	if (!buf) {
 		fprintf(stderr, "failed to allocate buffer\n");
-		goto err_close;
-	}
-
-	memset(buf, 0, buflen);
-
-	if (fread(buf + sizeof(struct file_header) + sizeof(struct image_header), length_unpadded, 1, f) != 1) {
-		fprintf(stderr, "failed to read input file\n");
-		goto err_free;
+		goto err_unmap;
 	}
 
-	fclose(f);
 	return 0;
 
-err_free:
-	free(buf);
-err_close:
-	fclose(f);
+err_unmap:
+	fw_unmap_file(&input);
 err:
 	return -1;
 }
@@ -211,7 +216,7 @@ static void build_file_header(uint32_t product_id, uint32_t device_id, uint32_t
 
 	header->length = cpu_to_be32(length);
 
-	crc = crc16_xmodem(buf + sizeof(struct image_header) + sizeof(struct file_header), length);
+	crc = crc16_xmodem_payload(0);
 	header->file_crc = cpu_to_be32(crc);
 
 	header->compression_type = cpu_to_be32(compression_type);
@@ -240,7 +245,8 @@ static void build_image_header(uint32_t product_id, uint32_t device_id) {
 	header->minute = 0;
 	header->second = 0;
 
-	crc = crc16_xmodem(buf + sizeof(struct file_header), buflen - sizeof(struct file_header));
+	crc = crc16_xmodem(buf + sizeof(struct file_header), hdrlen - sizeof(struct file_header));
+	crc = crc16_xmodem_payload(crc);
 	header->package_crc = cpu_to_be16(crc);
 	header->package_flag = cpu_to_be16(PACKAGE_FLAG);
 
@@ -268,7 +274,9 @@ static int write_output_file(char *filename) {
 		goto err;
 	}
 
-	if (fwrite(buf, buflen, 1, f) != 1) {
+	if (fwrite(buf, hdrlen, 1, f) != 1 ||
+	    fwrite(input.data, length_unpadded, 1, f) != 1 ||
+	    fwrite(zero_pad, 1, length - length_unpadded, f) != length - length_unpadded) {
 		fprintf(stderr, "failed to write output file\n");
 		ret = -1;
 	}
@@ -345,7 +353,7 @@ int main(int argc, char* argv[]) {
 		goto err;
 	}
 
-	if (create_buffer_and_read_file(input_filename)) {
+	if (map_input_file(input_filename)) {
 		goto err;
 	}
 
@@ -361,6 +369,7 @@ int main(int argc, char* argv[]) {
 
 err_free:
 	free(buf);
+	fw_unmap_file(&input);
 err:
 	return ret;
 }
@@ -24,6 +24,7 @@
 #  define HOST_TO_LE32(x)	bswap_32(x)
 #endif
 
+#include "crc32.h"
 #include "myloader.h"
 
 #define MAX_FW_BLOCKS  	32
@@ -236,55 +237,10 @@ usage(int status)
 	exit(status);
 }
 
-/*
- * Code to compute the CRC-32 table. Borrowed from
- * gzip-1.0.3/makecrc.c.
- */
-
-static uint32_t crc_32_tab[256];
-
-void
-init_crc_table(void)
-{
-	/* Not copyrighted 1990 Mark Adler	*/
-
-	uint32_t c;      /* crc shift register */
-	uint32_t e;      /* polynomial exclusive-or pattern */
-	int i;           /* counter for all possible eight bit values */
-	int k;           /* byte being shifted into crc apparatus */
-
-	/* terms of polynomial defining this crc (except x^32): */
-	static const int p[] = {0,1,2,4,5,7,8,10,11,12,16,22,23,26};
-
-	/* Make exclusive-or pattern from polynomial */
-	e = 0;
-	for (i = 0; i < sizeof(p)/sizeof(int); i++)
-		e |= 1L << (31 - p[i]);
-
-	crc_32_tab[0] = 0;
-
-	for (i = 1; i < 256; i++) {
-		c = 0;
-		for (k = i | 256; k != 1; k >>= 1) {
-			c = c & 1 ? (c >> 1) ^ e : c >> 1;
-			if (k & 1)
-				c ^= e;
-		}
-		crc_32_tab[i] = c;
-	}
-}
-
-
 void
 update_crc(uint8_t *p, uint32_t len, uint32_t *crc)
 {
-	uint32_t t;
-
-	t = *crc ^ 0xFFFFFFFFUL;
-	while (len--) {
-		t = crc_32_tab[(t ^ *p++) & 0xff] ^ (t >> 8);
-	}
-	*crc = t ^ 0xFFFFFFFFUL;
+	*crc = ~crc32_le_update(~*crc, p, len);
 }
 
 
@@ -350,53 +306,6 @@ find_board(char *model){
 }
 
 
-int
-get_file_crc(struct fw_block *ff)
-{
-	FILE *f;
-	uint8_t buf[FILE_BUF_LEN];
-	uint32_t readlen = sizeof(buf);
-	int res = -1;
-	size_t len;
-
-	if ((ff->flags & BLOCK_FLAG_HAVEHDR) == 0) {
-		res = 0;
-		goto out;
-	}
-
-	errno = 0;
-	f = fopen(ff->name,"r");
-	if (errno) {
-		errmsg(1,"unable to open file %s", ff->name);
-		goto out;
-	}
-
-	ff->crc = 0;
-	len = ff->size;
-	while (len > 0) {
-		if (len < readlen)
-			readlen = len;
-
-		errno = 0;
-		fread(buf, readlen, 1, f);
-		if (errno) {
-			errmsg(1,"unable to read from file %s",	ff->name);
-			goto out_close;
-		}
-
-		update_crc(buf, readlen, &ff->crc);
-		len -= readlen;
-	}
-
-	res = 0;
-
-out_close:
-	fclose(f);
-out:
-	return res;
-}
-
-
 int
 process_files(void)
 {
@@ -515,6 +424,10 @@ write_out_file(FILE *outfile, struct fw_block *block, uint32_t *crc)
 {
 	char buff[FILE_BUF_LEN];
 	size_t  buflen = sizeof(buff);
+	struct mylo_partition_header ph;
+	uint32_t dcrc = 0;	/* raw CRC of the file data, started from 0 */
+	uint32_t ocrc;
+	long hdrpos = 0;
 	FILE *f;
 	size_t len;
 
@@ -525,15 +438,15 @@ write_out_file(FILE *outfile, struct fw_block *block, uint32_t *crc)
 	}
 
 	if ((block->flags & BLOCK_FLAG_HAVEHDR) != 0) {
-		struct mylo_partition_header ph;
-
-		if (get_file_crc(block) != 0)
-		        return -1;
-
-		ph.crc = HOST_TO_LE32(block->crc);
+		/*
+		 * The CRC of the file is not known yet, reserve the header
+		 * and fill it in once the data has been copied.
+		 */
+		hdrpos = ftell(outfile);
 		ph.len = HOST_TO_LE32(block->size);
+		ph.crc = 0;
 
-		if (write_out_data(outfile, (uint8_t *)&ph, sizeof(ph), crc) != 0)
+		if (write_out_data(outfile, (uint8_t *)&ph, sizeof(ph), NULL) != 0)
 			return -1;
 	}
 
@@ -556,14 +469,35 @@ write_out_file(FILE *outfile, struct fw_block *block, uint32_t *crc)
 			return -1;
 		}
 
-		if (write_out_data(outfile, buff, buflen, crc) != 0)
+		if (write_out_data(outfile, buff, buflen, NULL) != 0)
 			return -1;
 
+		dcrc = crc32_le_update(dcrc, buff, buflen);
 		len -= buflen;
 	}
 
 	fclose(f);
 
+	/*
+	 * Both the partition header and the image CRC cover the file data,
+	 * derive them from dcrc instead of reading the file twice.
+	 */
+	ocrc = ~*crc;
+	if ((block->flags & BLOCK_FLAG_HAVEHDR) != 0) {
+		block->crc = ~crc32_le_combine(~0U, dcrc, block->size);
+		ph.crc = HOST_TO_LE32(block->crc);
+
+		errno = 0;
+		fflush(outfile);
+		if (pwrite(fileno(outfile), &ph, sizeof(ph), hdrpos) != sizeof(ph)) {
+			errmsg(1,"unable to write output file");
+			return -1;
+		}
+
+		ocrc = crc32_le_update(ocrc, &ph, sizeof(ph));
+	}
+	*crc = ~crc32_le_combine(ocrc, dcrc, block->size);
+
 	/* align next block on a 4 byte boundary */
 	len = block->size % 4;
 	if (write_out_padding(outfile, len, 0xFF, crc))
@@ -1252,7 +1186,6 @@ main(int argc, char *argv[])
 	}
 
 	crc = 0;
-	init_crc_table();
 
 	if (write_out_header(outfile, &crc) != 0)
 		goto out_flush;
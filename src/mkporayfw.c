@@ -29,6 +29,8 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include "csum.h"
+
 #if (__BYTE_ORDER == __BIG_ENDIAN)
 #  define HOST_TO_BE32(x)	(x)
 #  define BE32_TO_HOST(x)	(x)
@@ -465,14 +467,14 @@ static void fill_header(uint8_t *buf)
  */
 static uint16_t checksum_fw(uint8_t *data, int len)
 {
-	int i;
-	int32_t checksum = 0;
+	int32_t checksum;
 
-	for (i = 0; i < len - 1; i += 2) {
-		checksum += (data[i + 1] << 8) | data[i];
-	}
-	if (i < len) {
-		checksum += data[i];
+	if (len <= 0)
+		return 0;
+
+	checksum = (uint32_t) csum_add16_le(0, data, len);
+	if (len & 1) {
+		checksum += data[len - 1];
 	}
 	checksum = checksum + (checksum >> 16) + 0xffff;
 	checksum = ~(checksum + (checksum >> 16)) & 0xffff;
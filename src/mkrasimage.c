@@ -44,6 +44,8 @@
 
 #include <arpa/inet.h>
 
+#include "csum.h"
+
 #define VERSION_STRING_LEN 31
 #define ROOTFS_HEADER_LEN 40
 
@@ -152,12 +154,9 @@ static int sysv_chksm(const unsigned char *data, int size)
 {
     int r;
     int checksum;
-    unsigned int s = 0; /* The sum of all the input bytes, modulo (UINT_MAX + 1).  */
-
+    unsigned int s; /* The sum of all the input bytes, modulo (UINT_MAX + 1).  */
 
-    for (int i = 0; i < size; i++) {
-        s += data[i];
-    }
+    s = size > 0 ? csum_add8(0, data, size) : 0;
 
     r = (s & 0xffff) + ((s & 0xffffffff) >> 16);
     checksum = (r & 0xffff) + (r >> 16);
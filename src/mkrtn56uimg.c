@@ -16,6 +16,8 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include "crc32.h"
+
 #define IH_MAGIC	0x27051956
 #define IH_NMLEN	32
 #define IH_PRODLEN	23
@@ -75,7 +77,7 @@ typedef struct squashfs_sb {
 } squashfs_sb_t;
 
 typedef enum {
-	NONE, FACTORY, SYSUPGRADE,
+	NONE, FACTORY, SYSUPGRADE, PATCH,
 } op_mode_t;
 
 void
@@ -104,6 +106,9 @@ usage(const char *progname, int status)
 			"Options:\n"
 			"  -f <file>		generate a factory flash image <file>\n"
 			"  -s <file>		generate a sysupgrade flash image <file>\n"
+			"  -p <file>		patch bytes of image <file> and update its checksums\n"
+			"  -o <offset>		offset of the patch in the image (with -p)\n"
+			"  -d <file>		file with bytes to write at offset (with -p)\n"
 			"  -h			show this screen\n");
 	exit(status);
 }
@@ -243,17 +248,129 @@ process_image(char *progname, char *filename, op_mode_t opmode)
 	return EXIT_SUCCESS;
 }
 
+/*
+ * Apply the part of a patch that lies in the payload of hdr to its data
+ * CRC. CRC32 is linear, so only the replaced bytes are needed.
+ */
+static void
+patch_dcrc(image_header_t *hdr, uint32_t offset_data, uint32_t offset,
+	   const uint8_t *old, const uint8_t *new, uint32_t len)
+{
+	uint32_t size = ntohl(hdr->ih_size);
+	uint32_t from = offset > offset_data ? offset : offset_data;
+	uint32_t to = offset + len < offset_data + size ? offset + len : offset_data + size;
+
+	if (from >= to)
+		return;
+
+	hdr->ih_dcrc = htonl(crc32_le_patch(ntohl(hdr->ih_dcrc), size,
+					    from - offset_data, old + (from - offset),
+					    new + (from - offset), to - from));
+	hdr->ih_hcrc = 0;
+	hdr->ih_hcrc = htonl(crc32(0, (Bytef *)hdr, sizeof(image_header_t)));
+}
+
+int
+patch_image(char *progname, char *filename, uint32_t offset, char *patchname)
+{
+	int		fd, pfd;
+	uint8_t		*ptr, *new;
+	struct		stat sbuf, pbuf;
+	uint32_t	offset_sqfs, offset_sec_header;
+	squashfs_sb_t	*sqs;
+	image_header_t	*hdr, *sec_hdr = NULL;
+
+	if ((pfd = open(patchname, O_RDONLY)) < 0 || fstat(pfd, &pbuf) < 0) {
+		fprintf (stderr, "%s: Can't open %s: %s\n",
+			progname, patchname, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	if ((fd = open(filename, O_RDWR)) < 0 || fstat(fd, &sbuf) < 0) {
+		fprintf (stderr, "%s: Can't open %s: %s\n",
+			progname, filename, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	if (offset < sizeof(image_header_t) ||
+	    offset + pbuf.st_size > sbuf.st_size) {
+		fprintf (stderr, "%s: Patch doesn't fit in the payload of %s\n",
+			progname, filename);
+		return (EXIT_FAILURE);
+	}
+
+	ptr = mmap(0, sbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	new = mmap(0, pbuf.st_size, PROT_READ, MAP_PRIVATE, pfd, 0);
+	if (ptr == MAP_FAILED || new == MAP_FAILED) {
+		fprintf (stderr, "%s: Can't read %s: %s\n",
+			progname, filename, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	hdr = (image_header_t *)ptr;
+	if (ntohl(hdr->ih_magic) != IH_MAGIC) {
+		fprintf (stderr,
+			"%s: Bad Magic Number: \"%s\" is no valid image\n",
+			progname, filename);
+		return (EXIT_FAILURE);
+	}
+
+	/*
+	 * Factory images carry a second header at the end of the last
+	 * erase block, covering the kernel only. Find it like -f placed it.
+	 */
+	offset_sqfs = ntohl(hdr->tail.asus.ih_ksz);
+	if (offset_sqfs && offset_sqfs + sizeof(squashfs_sb_t) <= sbuf.st_size) {
+		sqs = (squashfs_sb_t *)(ptr + offset_sqfs);
+		offset_sec_header = offset_sqfs + sqs->bytes_used + sizeof(image_header_t);
+		offset_sec_header = (((offset_sec_header >> 16) + 1) << 16) - sizeof(image_header_t);
+		if (offset_sec_header + sizeof(image_header_t) <= sbuf.st_size &&
+		    ntohl(((image_header_t *)(ptr + offset_sec_header))->ih_magic) == IH_MAGIC)
+			sec_hdr = (image_header_t *)(ptr + offset_sec_header);
+	}
+
+	if (sec_hdr && offset < offset_sec_header + sizeof(image_header_t) &&
+	    offset + pbuf.st_size > offset_sec_header) {
+		fprintf (stderr, "%s: Patch overlaps the second header of %s\n",
+			progname, filename);
+		return (EXIT_FAILURE);
+	}
+
+	if (sec_hdr) {
+		image_header_t old_sec_hdr = *sec_hdr;
+
+		patch_dcrc(sec_hdr, sizeof(image_header_t), offset,
+			   ptr + offset, new, pbuf.st_size);
+		/* The second header is part of the first one's payload */
+		patch_dcrc(hdr, sizeof(image_header_t), offset_sec_header,
+			   (uint8_t *)&old_sec_hdr, (uint8_t *)sec_hdr,
+			   sizeof(image_header_t));
+	}
+	patch_dcrc(hdr, sizeof(image_header_t), offset, ptr + offset, new, pbuf.st_size);
+
+	memcpy(ptr + offset, new, pbuf.st_size);
+
+	(void) munmap((void *)new, pbuf.st_size);
+	(void) munmap((void *)ptr, sbuf.st_size);
+	(void) close (pfd);
+	(void) close (fd);
+
+	return EXIT_SUCCESS;
+}
+
 int
 main(int argc, char **argv)
 {
 	int 		opt;
 	char 		*filename = NULL;
+	char		*patchname = NULL;
+	uint32_t	offset = 0;
 	char		*progname;
 	op_mode_t	opmode = NONE;
 
 	progname = argv[0];
 
-	while ((opt = getopt(argc, argv,":s:f:h?")) != -1) {
+	while ((opt = getopt(argc, argv,":s:f:p:o:d:h?")) != -1) {
 		switch (opt) {
 		case 's':
 			opmode = SYSUPGRADE;
@@ -263,6 +380,16 @@ main(int argc, char **argv)
 			opmode = FACTORY;
 			filename = optarg;
 			break;
+		case 'p':
+			opmode = PATCH;
+			filename = optarg;
+			break;
+		case 'o':
+			offset = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			patchname = optarg;
+			break;
 		case 'h':
 			opmode = NONE;
 		default:
@@ -273,6 +400,8 @@ main(int argc, char **argv)
 
 	if(filename == NULL)
 		opmode = NONE;
+	if (opmode == PATCH && patchname == NULL)
+		opmode = NONE;
 
 	switch (opmode) {
 	case NONE:
@@ -282,6 +411,9 @@ main(int argc, char **argv)
 	case SYSUPGRADE:
 		return process_image(progname, filename, opmode);
 		break;
+	case PATCH:
+		return patch_image(progname, filename, offset, patchname);
+		break;
 	}
 
 	return EXIT_SUCCESS;
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "csum.h"
 #include "md5.h"
 
 #define HDR_LEN                 0x60
@@ -98,14 +99,8 @@ static long get_file_size(const char *filename)
 
 static int header_checksum(void *data, size_t len)
 {
-	int sum = 0; /* shouldn't this be unsigned ? */
-	size_t i;
-
-	if (data != NULL && len > 0) {
-		for (i = 0; i < len; ++i)
-			sum += ((unsigned char *)data)[i];
-		return sum;
-	}
+	if (data != NULL && len > 0)
+		return (int)csum_add8(0, data, len);
 
 	return -1;
 }
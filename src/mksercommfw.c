@@ -8,6 +8,8 @@
 #include <endian.h>
 #include <getopt.h>
 
+#include "csum.h"
+
 #if !defined(__BYTE_ORDER)
 #error "Unknown byte order"
 #endif
@@ -58,19 +60,12 @@ struct file_info {
 };
 
 static u_int8_t getCheckSum(char* data, int len) {
-	u_int8_t new = 0;
-	int i;
-
 	if (!data) {
 		ERR("Invalid pointer provided!\n");
 		return 0;
 	}
 
-	for (i = 0; i < len; i++) {
-		new += data[i];
-	}
-
-	return new;
+	return csum_add8(0, data, len);
 }
 
 /*
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
@@ -25,6 +26,7 @@
 #define CHECKSUM_SIZE	sizeof(uint32_t)
 #define MAX_FILES	32
 #define MAX_FILENAME	64
+#define COPY_CHUNK	(64 * 1024)
 
 #define DATE_SIZE	32
 #define REV_SIZE	32
@@ -104,6 +106,7 @@ struct firmware_file {
 	struct fw_header_file header;
 	size_t offset;
 	char filepath[PATH_MAX];
+	const uint8_t *data; /* mapped input file */
 };
 
 struct firmware {
@@ -112,6 +115,8 @@ struct firmware {
 	size_t files_count;
 	struct fw_header_kernel kernel_header;
 	char lower_endian;
+	const uint8_t *image; /* mapped firmware archive */
+	size_t image_size;
 };
 
 static size_t get_file_size(FILE *fp)
@@ -126,44 +131,35 @@ static size_t get_file_size(FILE *fp)
 	return file_size;
 }
 
-static void copy_from_to_file(FILE *fp_src, size_t src_offset, FILE *fp_dst,
-		       size_t dst_offset, size_t length)
+static const uint8_t *map_file(FILE *fp, size_t size)
 {
-	int buf[512];
-	size_t len;
-
-	if (src_offset)
-		fseek(fp_src, (long int)src_offset, SEEK_SET);
-
-	if (dst_offset)
-		fseek(fp_src, (long int)dst_offset, SEEK_SET);
+	void *data;
 
-	while (length) {
-		if (length >= sizeof(buf)) {
-			len = sizeof(buf);
-		} else {
-			len = length;
-		}
+	if (!size)
+		return NULL;
 
-		length -= len;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if (data == MAP_FAILED)
+		error("Failed to map file\n");
 
-		if (fread(buf, len, 1, fp_src) != 1)
-			error("Failed to read");
+	return data;
+}
 
-		if (fwrite(buf, len, 1, fp_dst) != 1)
-			error("Failed to write");
-	}
+static void unmap_file(const uint8_t *data, size_t size)
+{
+	if (data)
+		munmap((void *)data, size);
 }
 
-static void extract_to_file(FILE *fp_src, char *dst, size_t length,
-			    size_t offset)
+static void extract_to_file(const uint8_t *src, char *dst, size_t length)
 {
 	FILE *fp_dst;
 
 	if (!(fp_dst = fopen(dst, "wb")))
 		error("Failed to open %s for writing", dst);
 
-	copy_from_to_file(fp_src, offset, fp_dst, 0, length);
+	if (length && fwrite(src, length, 1, fp_dst) != 1)
+		error("Failed to write");
 
 	fclose(fp_dst);
 }
@@ -293,37 +289,14 @@ static void translate_kernel_header(struct fw_header_kernel *kernel_header)
 	kernel_header->baudrate = ntohl(kernel_header->baudrate);
 }
 
-static void checksum_add_from_buf(MD5_CTX *ctx, void *buf,
+static void checksum_add_from_buf(MD5_CTX *ctx, const void *buf,
 			    size_t length, size_t offset)
 {
-	char *begin = &((char *)buf)[offset];
+	const char *begin = &((const char *)buf)[offset];
 
 	MD5_Update(ctx, begin, length);
 }
 
-static void checksum_add_from_file(MD5_CTX *ctx, FILE *fp_src,
-			    size_t length, size_t offset)
-{
-	int buf[512];
-	size_t len;
-
-	fseek(fp_src, (long int)offset, SEEK_SET);
-	while (length) {
-		if (length >= sizeof(buf)) {
-			len = sizeof(buf);
-		} else {
-			len = length;
-		}
-
-		length -= len;
-
-		if (fread(buf, len, 1, fp_src) != 1)
-			error("Failed to read for checksum calculation");
-
-		checksum_add_from_buf(ctx, buf, len, 0);
-	}
-}
-
 static uint32_t checksum_finish(MD5_CTX *ctx)
 {
 	unsigned char md5sum[16];
@@ -344,47 +317,39 @@ static uint32_t checksum_finish(MD5_CTX *ctx)
 	return checksum;
 }
 
-static uint32_t checksum_calculate(FILE *fp, size_t kernel_offset)
+/* the archive checksum skips itself and sees a zeroed kernel header */
+static void checksum_add_kernel_header(MD5_CTX *ctx)
 {
 	struct fw_header_kernel dummy;
-	MD5_CTX ctx;
-	size_t file_size;
-
-	fseek(fp, 0, SEEK_SET);
-	file_size = get_file_size(fp);
 
-	MD5_Init(&ctx);
+	memset(&dummy, 0, sizeof(dummy));
+	checksum_add_from_buf(ctx, &dummy, sizeof(dummy), 0);
+}
 
-	checksum_add_from_file(&ctx, fp, kernel_offset - CHECKSUM_SIZE,
-			       CHECKSUM_SIZE);
+static uint32_t checksum_calculate(const uint8_t *buf, size_t size,
+				   size_t kernel_offset)
+{
+	MD5_CTX ctx;
 
-	/* use a zeroed out kernel version header */
-	memset(&dummy, 0, sizeof(dummy));
-	checksum_add_from_buf(&ctx, &dummy, sizeof(dummy), 0);
+	MD5_Init(&ctx);
 
-	checksum_add_from_file(&ctx, fp,
-			       file_size - kernel_offset - sizeof(dummy),
-			       kernel_offset + sizeof(dummy));
+	checksum_add_from_buf(&ctx, buf, kernel_offset - CHECKSUM_SIZE,
+			      CHECKSUM_SIZE);
+	checksum_add_kernel_header(&ctx);
+	checksum_add_from_buf(&ctx, buf,
+			      size - kernel_offset -
+				      sizeof(struct fw_header_kernel),
+			      kernel_offset + sizeof(struct fw_header_kernel));
 
 	return checksum_finish(&ctx);
 }
 
-static uint32_t checksum_calculate_file(char *filename)
+static uint32_t checksum_calculate_buf(const uint8_t *buf, size_t length)
 {
 	MD5_CTX ctx;
-	FILE *fp;
-	size_t file_size;
-
-	if (!(fp = fopen(filename, "rb")))
-		error("Failed to open %s for writing\n", filename);
-
-	file_size = get_file_size(fp);
 
 	MD5_Init(&ctx);
-
-	checksum_add_from_file(&ctx, fp, file_size, 0);
-
-	fclose(fp);
+	checksum_add_from_buf(&ctx, buf, length, 0);
 
 	return checksum_finish(&ctx);
 }
@@ -392,7 +357,7 @@ static uint32_t checksum_calculate_file(char *filename)
 static void parse_firmware(struct firmware *fw, FILE *fp)
 {
 	struct firmware_file *file;
-	size_t file_size, file_offset, kernel_offset;
+	size_t file_size, file_offset, kernel_offset = 0;
 	uint32_t checksum = 0;
 	int i;
 
@@ -461,9 +426,17 @@ static void parse_firmware(struct firmware *fw, FILE *fp)
 	if (!kernel_offset)
 		error("Kernel image missing for checksum calculation\n");
 
+	if (kernel_offset + sizeof(fw->kernel_header) > file_size)
+		error("Kernel header exceeds size of firmware archive\n");
+
+	/* read the whole archive once: checksum and extraction both work
+	 * on the same mapping */
+	fw->image_size = file_size;
+	fw->image = map_file(fp, file_size);
+
 	/* as we know the kernel offset, we can calculate the checksum
 	 * as it must be excluded from checksum calculation */
-	checksum = checksum_calculate(fp, kernel_offset);
+	checksum = checksum_calculate(fw->image, file_size, kernel_offset);
 
 	if (fw->lower_endian)
 		checksum = ntohl(checksum);
@@ -471,9 +444,8 @@ static void parse_firmware(struct firmware *fw, FILE *fp)
 	if (checksum != fw->header.checksum)
 		printf("WARN: Checksum mismatch. Calculated 0x%x\n", checksum);
 
-	fseek(fp, (long int)kernel_offset, SEEK_SET);
-	if (1 != fread(&fw->kernel_header, sizeof(fw->kernel_header), 1, fp))
-		error("Failed to read kernel header\n");
+	memcpy(&fw->kernel_header, fw->image + kernel_offset,
+	       sizeof(fw->kernel_header));
 
 	if (fw->lower_endian)
 		translate_kernel_header(&fw->kernel_header);
@@ -496,23 +468,25 @@ static void extract_firmware(struct firmware *fw, char *filename)
 	printf("Extracting files...");
 
 	for (i = 0, file = fw->files; i < fw->header.files_count; i++, file++) {
+		const uint8_t *data = fw->image + file->offset;
+		size_t length = file->header.length;
+
 		dump_file_header(&file->header);
 		if (file->header.type == FILE_TYPE_KERNEL) {
 			/* strip kernel header */
-			extract_to_file(
-				fp, file->header.filename,
-				file->header.length -
-					sizeof(struct fw_header_kernel),
-				file->offset + sizeof(struct fw_header_kernel));
-		} else {
-			extract_to_file(fp, file->header.filename,
-					file->header.length, file->offset);
+			if (length < sizeof(struct fw_header_kernel))
+				error("Kernel file too small\n");
+			data += sizeof(struct fw_header_kernel);
+			length -= sizeof(struct fw_header_kernel);
 		}
 
+		extract_to_file(data, file->header.filename, length);
+
 		printf("Calculated file checksum is 0x%08x\n",
-		       checksum_calculate_file(file->header.filename));
+		       checksum_calculate_buf(data, length));
 	}
 
+	unmap_file(fw->image, fw->image_size);
 	free(fw->files);
 	fclose(fp);
 }
@@ -531,7 +505,7 @@ static void init_fw_header(struct firmware *fw)
 	fw->header.magic = ZYXEL_MAGIC;
 }
 
-static void write_headers(FILE *fp, struct firmware *fw)
+static void write_headers(FILE *fp, struct firmware *fw, MD5_CTX *ctx)
 {
 	struct firmware_file *file;
 	unsigned int i;
@@ -541,10 +515,36 @@ static void write_headers(FILE *fp, struct firmware *fw)
 	if (1 != fwrite(&fw->header, sizeof(fw->header), 1, fp))
 		error("Failed to write firmware header\n");
 
-	for (i = 0, file = fw->files; i < fw->files_count; i++, file++)
+	checksum_add_from_buf(ctx, &fw->header,
+			      sizeof(fw->header) - CHECKSUM_SIZE, CHECKSUM_SIZE);
+
+	for (i = 0, file = fw->files; i < fw->files_count; i++, file++) {
 		if (1 !=
 		    fwrite(&file->header, sizeof(struct fw_header_file), 1, fp))
 			error("Failed to write file header #%u\n", i + 1);
+
+		checksum_add_from_buf(ctx, &file->header,
+				      sizeof(struct fw_header_file), 0);
+	}
+}
+
+/* copy a mapped input file to the archive, hashing it on the way */
+static void write_file_data(FILE *fp, MD5_CTX *ctx, const uint8_t *data,
+			    size_t length)
+{
+	size_t len;
+
+	while (length) {
+		len = length < COPY_CHUNK ? length : COPY_CHUNK;
+
+		if (fwrite(data, len, 1, fp) != 1)
+			error("Failed to write");
+
+		checksum_add_from_buf(ctx, data, len, 0);
+
+		data += len;
+		length -= len;
+	}
 }
 
 static void usage(char *progname)
@@ -580,6 +580,7 @@ int main(int argc, char *argv[])
 	const char *separator = " | ";
 	char *filename;
 	FILE *fp_src, *fp_dst;
+	MD5_CTX ctx;
 	size_t kernel_offset = 0;
 	unsigned int i;
 	int opt;
@@ -730,35 +731,24 @@ int main(int argc, char *argv[])
 			      fw.files[i].filepath);
 	}
 
-	filename = argv[optind];
-	if (!(fp_dst = fopen(filename, "w+b")))
-		error("Failed to open %s for writing\n", filename);
-
-	write_headers(fp_dst, &fw);
-
 	fw.header.info_length = sizeof(struct fw_header_file);
 	fw.header.files_offset =
 		sizeof(fw.header) + fw.files_count * fw.header.info_length;
-	if ((size_t)ftell(fp_dst) != fw.header.files_offset)
-		error("Oops. Something went wrong writing the file headers");
 
+	/* the file headers carry the file checksums and precede the data,
+	 * so hash every input file before anything is written out */
 	fw.header.total_length = fw.header.files_offset;
 	for (i = 0, file = fw.files; i < fw.files_count; i++, file++) {
-		file->header.checksum = checksum_calculate_file(file->filepath);
-
 		if (!(fp_src = fopen(file->filepath, "rb")))
-			error("Failed to open %s for writing\n", filename);
+			error("Failed to open %s for reading\n",
+			      file->filepath);
 
 		file->offset = fw.header.total_length;
 
 		file->header.length = get_file_size(fp_src);
-
-		if (file->header.type == FILE_TYPE_KERNEL)
-			if (1 != fwrite(&fw.kernel_header,
-					sizeof(fw.kernel_header), 1, fp_dst))
-				error("Failed to write kernel header\n");
-
-		copy_from_to_file(fp_src, 0, fp_dst, 0, file->header.length);
+		file->data = map_file(fp_src, file->header.length);
+		file->header.checksum =
+			checksum_calculate_buf(file->data, file->header.length);
 
 		if (file->header.type == FILE_TYPE_KERNEL) {
 			file->header.length += sizeof(fw.kernel_header);
@@ -786,16 +776,42 @@ int main(int argc, char *argv[])
 		fclose(fp_src);
 	}
 
+	if (!kernel_offset)
+		error("Kernel image needed for checksum calculation\n");
+
 	/* update headers with correct lengths and endianness */
 	translate_fw_header(&fw.header);
 
-	write_headers(fp_dst, &fw);
+	filename = argv[optind];
+	if (!(fp_dst = fopen(filename, "w+b")))
+		error("Failed to open %s for writing\n", filename);
 
-	if (!kernel_offset)
-		error("Kernel image needed for checksum calculation\n");
+	/* the archive checksum is calculated while writing, with the
+	 * kernel header zeroed as it is only filled in afterwards */
+	MD5_Init(&ctx);
+
+	write_headers(fp_dst, &fw, &ctx);
+
+	for (i = 0, file = fw.files; i < fw.files_count; i++, file++) {
+		size_t length = ntohl(file->header.length);
+
+		if (ntohs(file->header.type) == FILE_TYPE_KERNEL) {
+			struct fw_header_kernel dummy;
+
+			memset(&dummy, 0, sizeof(dummy));
+			if (1 != fwrite(&dummy, sizeof(dummy), 1, fp_dst))
+				error("Failed to write kernel header\n");
+
+			checksum_add_kernel_header(&ctx);
+			length -= sizeof(dummy);
+		}
+
+		write_file_data(fp_dst, &ctx, file->data, length);
+		unmap_file(file->data, length);
+	}
 
 	/* update headers with correct checksum */
-	fw.header.checksum = htonl(checksum_calculate(fp_dst, kernel_offset));
+	fw.header.checksum = htonl(checksum_finish(&ctx));
 	fseek(fp_dst, 0, SEEK_SET);
 	fwrite(&fw.header.checksum, sizeof(fw.header.checksum), 1, fp_dst);
 
@@ -14,6 +14,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "fwcopy.h"
+#include "fwread.h"
 #include "md5.h"
 
 #if !defined(__BYTE_ORDER)
@@ -266,9 +268,7 @@ out:
 
 static ssize_t oseama_entity_append_file(FILE *seama, const char *in_path) {
 	FILE *in;
-	size_t bytes;
-	ssize_t length = 0;
-	uint8_t buf[128];
+	ssize_t length;
 
 	in = fopen(in_path, "r");
 	if (!in) {
@@ -276,13 +276,10 @@ static ssize_t oseama_entity_append_file(FILE *seama, const char *in_path) {
 		return -EACCES;
 	}
 
-	while ((bytes = fread(buf, 1, sizeof(buf), in)) > 0) {
-		if (fwrite(buf, 1, bytes, seama) != bytes) {
-			fprintf(stderr, "Couldn't write %zu B to %s\n", bytes, seama_path);
-			length = -EIO;
-			break;
-		}
-		length += bytes;
+	length = fw_copy_stream(in, seama);
+	if (length < 0) {
+		fprintf(stderr, "Couldn't copy %s to %s\n", in_path, seama_path);
+		length = -EIO;
 	}
 
 	fclose(in);
@@ -318,18 +315,20 @@ static ssize_t oseama_entity_align(FILE *seama, size_t curr_offset, size_t align
 
 static int oseama_entity_write_hdr(FILE *seama, size_t metasize, size_t imagesize) {
 	struct seama_entity_header hdr = {};
-	uint8_t buf[128];
-	size_t length = imagesize;
+	struct fw_reader *rd;
+	const uint8_t *buf;
 	size_t bytes;
 	MD5_CTX ctx;
 
 	fseek(seama, sizeof(hdr) + metasize, SEEK_SET);
+	rd = fw_reader_open(seama, imagesize);
+	if (!rd)
+		return -ENOMEM;
 	MD5_Init(&ctx);
-	while ((bytes = fread(buf, 1, oseama_min(sizeof(buf), length), seama)) > 0) {
+	while ((bytes = fw_reader_next(rd, &buf)) > 0)
 		MD5_Update(&ctx, buf, bytes);
-		length -= bytes;
-	}
 	MD5_Final(hdr.md5, &ctx);
+	fw_reader_close(rd);
 
 	hdr.magic = cpu_to_be32(SEAMA_MAGIC);
 	hdr.metasize = cpu_to_be16(metasize);
@@ -457,7 +456,8 @@ static void oseama_extract_parse_options(int argc, char **argv) {
 static int oseama_extract_entity(FILE *seama, FILE *out) {
 	struct seama_entity_header hdr;
 	size_t bytes, metasize, imagesize, length;
-	uint8_t buf[1024];
+	struct fw_reader *rd;
+	const uint8_t *buf;
 	int i = 0;
 	int err = 0;
 
@@ -483,7 +483,12 @@ static int oseama_extract_entity(FILE *seama, FILE *out) {
 		}
 
 		length = metasize + imagesize;
-		while ((bytes = fread(buf, 1, oseama_min(sizeof(buf), length), seama)) > 0) {
+		rd = fw_reader_open(seama, length);
+		if (!rd) {
+			err = -ENOMEM;
+			break;
+		}
+		while ((bytes = fw_reader_next(rd, &buf)) > 0) {
 			if (fwrite(buf, 1, bytes, out) != bytes) {
 				fprintf(stderr, "Couldn't write %zu B to %s\n", bytes, out_path);
 				err = -EIO;
@@ -491,6 +496,7 @@ static int oseama_extract_entity(FILE *seama, FILE *out) {
 			}
 			length -= bytes;
 		}
+		fw_reader_close(rd);
 
 		if (length) {
 			fprintf(stderr, "Couldn't extract whole entity %d from %s (%zu B left)\n", entity_idx, seama_path, length);
@@ -566,6 +572,123 @@ out:
 	return err;
 }
 
+/**************************************************
+ * Edit
+ **************************************************/
+
+static int oseama_edit(int argc, char **argv) {
+	FILE *seama;
+	struct seama_seal_header hdr;
+	struct seama_entity_header entity;
+	uint8_t meta[1024] = { };
+	size_t newsize = 0;
+	size_t metasize;
+	size_t len;
+	size_t bytes;
+	int c;
+	int i;
+	int err = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "No Seama file passed\n");
+		err = -EINVAL;
+		goto out;
+	}
+	seama_path = argv[2];
+
+	optind = 3;
+	while ((c = getopt(argc, argv, "e:m:")) != -1) {
+		switch (c) {
+		case 'e':
+			entity_idx = atoi(optarg);
+			break;
+		case 'm':
+			len = strlen(optarg) + 1;
+			if (newsize + len > sizeof(meta)) {
+				fprintf(stderr, "Too much meta info\n");
+				err = -EINVAL;
+				goto out;
+			}
+			memcpy(&meta[newsize], optarg, len);
+			newsize = (newsize + len + 3) & ~3;
+			break;
+		}
+	}
+
+	if (!newsize) {
+		fprintf(stderr, "No meta specified\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	seama = fopen(seama_path, "r+");
+	if (!seama) {
+		fprintf(stderr, "Couldn't open %s\n", seama_path);
+		err = -EACCES;
+		goto out;
+	}
+
+	bytes = fread(&hdr, 1, sizeof(hdr), seama);
+	if (bytes != sizeof(hdr)) {
+		fprintf(stderr, "Couldn't read %s header\n", seama_path);
+		err =  -EIO;
+		goto err_close;
+	}
+
+	if (be32_to_cpu(hdr.magic) != SEAMA_MAGIC) {
+		fprintf(stderr, "Invalid Seama magic: 0x%08x\n", be32_to_cpu(hdr.magic));
+		err =  -EINVAL;
+		goto err_close;
+	}
+	metasize = be16_to_cpu(hdr.metasize);
+
+	/* Walk entity headers only, the data is skipped with fseek */
+	for (i = 0; i <= entity_idx; i++) {
+		if (fseek(seama, metasize, SEEK_CUR) ||
+		    fread(&entity, 1, sizeof(entity), seama) != sizeof(entity)) {
+			fprintf(stderr, "Couldn't find entity %d in %s\n", entity_idx, seama_path);
+			err = -ENOENT;
+			goto err_close;
+		}
+		if (be32_to_cpu(entity.magic) != SEAMA_MAGIC) {
+			fprintf(stderr, "Invalid Seama magic: 0x%08x\n", be32_to_cpu(entity.magic));
+			err =  -EINVAL;
+			goto err_close;
+		}
+		metasize = be16_to_cpu(entity.metasize);
+		if (i < entity_idx)
+			metasize += be32_to_cpu(entity.imagesize);
+	}
+
+	/*
+	 * Entity MD5 covers image data only, so meta can be replaced in place
+	 * as long as its size doesn't change (which would move the image).
+	 */
+	if (newsize > metasize) {
+		fprintf(stderr, "New meta (%zu B) doesn't fit in existing %zu B\n", newsize, metasize);
+		err = -ENOSPC;
+		goto err_close;
+	}
+	if (metasize > sizeof(meta)) {
+		fprintf(stderr, "Too small buffer (%zu B) to write all meta info (%zd B)\n", sizeof(meta), metasize);
+		err = -EINVAL;
+		goto err_close;
+	}
+
+	/* Switching from reading to writing requires a seek */
+	fseek(seama, 0, SEEK_CUR);
+	bytes = fwrite(meta, 1, metasize, seama);
+	if (bytes != metasize) {
+		fprintf(stderr, "Couldn't write %zu B of meta to %s\n", metasize, seama_path);
+		err = -EIO;
+	}
+
+err_close:
+	fclose(seama);
+out:
+	return err;
+}
+
 /**************************************************
  * Start
  **************************************************/
@@ -587,6 +710,11 @@ static void usage() {
 	printf("\toseama extract <file> [options]\n");
 	printf("\t-e\t\t\t\tindex of entity to extract\n");
 	printf("\t-o file\t\t\t\toutput file\n");
+	printf("\n");
+	printf("Replace meta of Seama seal or entity in place:\n");
+	printf("\toseama edit <file> [options]\n");
+	printf("\t-e\t\t\t\tindex of entity to edit (default: seal)\n");
+	printf("\t-m meta\t\t\t\tmeta info to put in header (replaces all old entries)\n");
 }
 
 int main(int argc, char **argv) {
@@ -597,6 +725,8 @@ int main(int argc, char **argv) {
 			return oseama_entity(argc, argv);
 		else if (!strcmp(argv[1], "extract"))
 			return oseama_extract(argc, argv);
+		else if (!strcmp(argv[1], "edit"))
+			return oseama_edit(argc, argv);
 	}
 
 	usage();
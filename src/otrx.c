@@ -8,6 +8,7 @@
 #include <byteswap.h>
 #include <endian.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +16,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "crc32.h"
+#include "fwcopy.h"
+#include "fwdev.h"
+#include "fwmanifest.h"
+#include "fwread.h"
+
 #if !defined(__BYTE_ORDER)
 #error "Unknown byte order"
 #endif
@@ -22,9 +29,13 @@
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define cpu_to_le32(x)	bswap_32(x)
 #define le32_to_cpu(x)	bswap_32(x)
+#define cpu_to_le16(x)	bswap_16(x)
+#define le16_to_cpu(x)	bswap_16(x)
 #elif __BYTE_ORDER == __LITTLE_ENDIAN
 #define cpu_to_le32(x)	(x)
 #define le32_to_cpu(x)	(x)
+#define cpu_to_le16(x)	(x)
+#define le16_to_cpu(x)	(x)
 #else
 #error "Unsupported endianness"
 #endif
@@ -57,92 +68,14 @@ struct otrx_ctx {
 char *trx_path;
 size_t trx_offset = 0;
 char *partition[TRX_MAX_PARTS] = {};
+char *manifest_path;
+char *dev_path;
+size_t erase_block = FW_MANIFEST_BLOCK;
 
 static inline size_t otrx_min(size_t x, size_t y) {
 	return x < y ? x : y;
 }
 
-/**************************************************
- * CRC32
- **************************************************/
-
-static const uint32_t crc32_tbl[] = {
-	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba,
-	0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
-	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
-	0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de,
-	0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec,
-	0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
-	0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
-	0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940,
-	0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116,
-	0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
-	0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
-	0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a,
-	0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818,
-	0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
-	0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
-	0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c,
-	0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2,
-	0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
-	0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
-	0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086,
-	0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4,
-	0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
-	0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
-	0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8,
-	0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe,
-	0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
-	0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
-	0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252,
-	0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60,
-	0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
-	0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
-	0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04,
-	0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a,
-	0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
-	0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
-	0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e,
-	0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c,
-	0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
-	0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
-	0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0,
-	0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6,
-	0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
-	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
-};
-
-uint32_t otrx_crc32(uint32_t crc, uint8_t *buf, size_t len) {
-	while (len) {
-		crc = crc32_tbl[(crc ^ *buf) & 0xff] ^ (crc >> 8);
-		buf++;
-		len--;
-	}
-
-	return crc;
-}
-
 /**************************************************
  * Helpers
  **************************************************/
@@ -277,8 +210,9 @@ static void otrx_check_parse_options(int argc, char **argv) {
 
 static int otrx_check(int argc, char **argv) {
 	struct otrx_ctx otrx = { };
+	struct fw_reader *rd;
 	size_t bytes, length;
-	uint8_t buf[1024];
+	const uint8_t *buf;
 	uint32_t crc32;
 	int err = 0;
 
@@ -300,12 +234,18 @@ static int otrx_check(int argc, char **argv) {
 	}
 
 	crc32 = 0xffffffff;
-	crc32 = otrx_crc32(crc32, (uint8_t *)&otrx.hdr + TRX_FLAGS_OFFSET, sizeof(otrx.hdr) - TRX_FLAGS_OFFSET);
+	crc32 = crc32_le_update(crc32, (uint8_t *)&otrx.hdr + TRX_FLAGS_OFFSET, sizeof(otrx.hdr) - TRX_FLAGS_OFFSET);
 	length = le32_to_cpu(otrx.hdr.length) - sizeof(otrx.hdr);
-	while ((bytes = fread(buf, 1, otrx_min(sizeof(buf), length), otrx.fp)) > 0) {
-		crc32 = otrx_crc32(crc32, buf, bytes);
+	rd = fw_reader_open(otrx.fp, length);
+	if (!rd) {
+		err = -ENOMEM;
+		goto err_close;
+	}
+	while ((bytes = fw_reader_next(rd, &buf)) > 0) {
+		crc32 = crc32_le_update(crc32, buf, bytes);
 		length -= bytes;
 	}
+	fw_reader_close(rd);
 
 	if (length) {
 		fprintf(stderr, "Couldn't read last %zd B of data from %s\n", length, trx_path);
@@ -333,9 +273,7 @@ out:
 
 static ssize_t otrx_create_append_file(FILE *trx, const char *in_path) {
 	FILE *in;
-	size_t bytes;
-	ssize_t length = 0;
-	uint8_t buf[1024];
+	ssize_t length;
 
 	in = fopen(in_path, "r");
 	if (!in) {
@@ -343,13 +281,10 @@ static ssize_t otrx_create_append_file(FILE *trx, const char *in_path) {
 		return -EACCES;
 	}
 
-	while ((bytes = fread(buf, 1, sizeof(buf), in)) > 0) {
-		if (fwrite(buf, 1, bytes, trx) != bytes) {
-			fprintf(stderr, "Couldn't write %zu B to %s\n", bytes, trx_path);
-			length = -EIO;
-			break;
-		}
-		length += bytes;
+	length = fw_copy_stream(in, trx);
+	if (length < 0) {
+		fprintf(stderr, "Couldn't copy %s to %s\n", in_path, trx_path);
+		length = -EIO;
 	}
 
 	fclose(in);
@@ -386,8 +321,9 @@ static ssize_t otrx_create_align(FILE *trx, size_t curr_offset, size_t alignment
 }
 
 static int otrx_create_write_hdr(FILE *trx, struct trx_header *hdr) {
+	struct fw_reader *rd;
 	size_t bytes, length;
-	uint8_t buf[1024];
+	const uint8_t *buf;
 	uint32_t crc32;
 
 	hdr->version = 1;
@@ -404,10 +340,12 @@ static int otrx_create_write_hdr(FILE *trx, struct trx_header *hdr) {
 	crc32 = 0xffffffff;
 	fseek(trx, TRX_FLAGS_OFFSET, SEEK_SET);
 	length -= TRX_FLAGS_OFFSET;
-	while ((bytes = fread(buf, 1, otrx_min(sizeof(buf), length), trx)) > 0) {
-		crc32 = otrx_crc32(crc32, buf, bytes);
-		length -= bytes;
-	}
+	rd = fw_reader_open(trx, length);
+	if (!rd)
+		return -ENOMEM;
+	while ((bytes = fw_reader_next(rd, &buf)) > 0)
+		crc32 = crc32_le_update(crc32, buf, bytes);
+	fw_reader_close(rd);
 	hdr->crc32 = cpu_to_le32(crc32);
 
 	fseek(trx, 0, SEEK_SET);
@@ -449,7 +387,7 @@ static int otrx_create(int argc, char **argv) {
 	fseek(trx, curr_offset, SEEK_SET);
 
 	optind = 3;
-	while ((c = getopt(argc, argv, "f:A:a:b:M:")) != -1) {
+	while ((c = getopt(argc, argv, "f:A:a:b:M:m:D:E:")) != -1) {
 		switch (c) {
 		case 'f':
 			if (curr_idx >= TRX_MAX_PARTS) {
@@ -514,6 +452,20 @@ static int otrx_create(int argc, char **argv) {
 			else
 				hdr.magic = cpu_to_le32(magic);
 			break;
+		case 'm':
+			manifest_path = optarg;
+			break;
+		case 'D':
+			dev_path = optarg;
+			break;
+		case 'E':
+			erase_block = strtoul(optarg, NULL, 0);
+			if (!erase_block) {
+				fprintf(stderr, "Invalid erase block size %s\n", optarg);
+				err = -EINVAL;
+				goto err_close;
+			}
+			break;
 		}
 		if (err)
 			break;
@@ -529,6 +481,24 @@ static int otrx_create(int argc, char **argv) {
 	otrx_create_write_hdr(trx, &hdr);
 err_close:
 	fclose(trx);
+
+	/* The header CRC is written last, so hash the finished file */
+	if (!err && manifest_path &&
+	    fw_manifest_write_file(manifest_path, trx_path, erase_block)) {
+		fprintf(stderr, "Couldn't write manifest %s\n", manifest_path);
+		err = -EIO;
+	}
+
+	if (!err && dev_path) {
+		struct fw_dev_result res;
+
+		if (fw_dev_write_file(dev_path, trx_path, erase_block, &res)) {
+			fprintf(stderr, "Couldn't write %s to %s: %s\n", trx_path, dev_path, strerror(errno));
+			err = -EIO;
+		} else {
+			printf("Wrote %zu of %zu erase blocks to %s\n", res.written, res.blocks, dev_path);
+		}
+	}
 out:
 	return err;
 }
@@ -640,6 +610,215 @@ err_out:
 	return err;
 }
 
+/**************************************************
+ * Edit
+ **************************************************/
+
+static int otrx_edit(int argc, char **argv) {
+	struct otrx_ctx otrx = { };
+	struct trx_header hdr;
+	long flags = -1;
+	long version = -1;
+	size_t length;
+	uint32_t crc32;
+	size_t bytes;
+	int err = 0;
+	int c;
+
+	if (argc < 3) {
+		fprintf(stderr, "No TRX file passed\n");
+		err = -EINVAL;
+		goto out;
+	}
+	trx_path = argv[2];
+
+	optind = 3;
+	while ((c = getopt(argc, argv, "o:F:V:")) != -1) {
+		switch (c) {
+		case 'o':
+			trx_offset = atoi(optarg);
+			break;
+		case 'F':
+			flags = strtol(optarg, NULL, 0);
+			break;
+		case 'V':
+			version = strtol(optarg, NULL, 0);
+			break;
+		}
+	}
+
+	if (flags < 0 && version < 0) {
+		fprintf(stderr, "Nothing to edit, use -F and/or -V\n");
+		err = -EINVAL;
+		goto out;
+	}
+	if (flags > 0xffff || version > 0xffff) {
+		fprintf(stderr, "Flags and version have to fit in 16 bits\n");
+		err = -EINVAL;
+		goto out;
+	}
+	if (!strcmp(trx_path, "-")) {
+		fprintf(stderr, "Editing stdin is unsupported\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = otrx_open_parse(trx_path, "r+", &otrx);
+	if (err) {
+		fprintf(stderr, "Couldn't open & parse %s: %d\n", trx_path, err);
+		err = -EACCES;
+		goto out;
+	}
+
+	hdr = otrx.hdr;
+	if (flags >= 0)
+		hdr.flags = cpu_to_le16(flags);
+	if (version >= 0)
+		hdr.version = cpu_to_le16(version);
+
+	/* Only 4 bytes at the start of the CRC covered range change */
+	length = le32_to_cpu(hdr.length) - TRX_FLAGS_OFFSET;
+	crc32 = crc32_le_patch(le32_to_cpu(hdr.crc32), length, 0,
+			       (uint8_t *)&otrx.hdr + TRX_FLAGS_OFFSET,
+			       (uint8_t *)&hdr + TRX_FLAGS_OFFSET, 4);
+	hdr.crc32 = cpu_to_le32(crc32);
+
+	fseek(otrx.fp, trx_offset, SEEK_SET);
+	bytes = fwrite(&hdr, 1, sizeof(hdr), otrx.fp);
+	if (bytes != sizeof(hdr)) {
+		fprintf(stderr, "Couldn't write TRX header to %s\n", trx_path);
+		err = -EIO;
+	}
+
+	otrx_close(otrx.fp);
+out:
+	return err;
+}
+
+/**************************************************
+ * Patch
+ **************************************************/
+
+static int otrx_patch(int argc, char **argv) {
+	struct otrx_ctx otrx = { };
+	const char *in_path = NULL;
+	long offset = -1;
+	uint8_t *old_data = NULL;
+	uint8_t *new_data = NULL;
+	struct stat st;
+	size_t length;
+	uint32_t crc32;
+	size_t bytes;
+	FILE *in;
+	int err = 0;
+	int c;
+
+	if (argc < 3) {
+		fprintf(stderr, "No TRX file passed\n");
+		err = -EINVAL;
+		goto out;
+	}
+	trx_path = argv[2];
+
+	optind = 3;
+	while ((c = getopt(argc, argv, "o:p:f:")) != -1) {
+		switch (c) {
+		case 'o':
+			trx_offset = atoi(optarg);
+			break;
+		case 'p':
+			offset = strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			in_path = optarg;
+			break;
+		}
+	}
+
+	if (offset < 0 || !in_path) {
+		fprintf(stderr, "Patch offset (-p) and file (-f) are required\n");
+		err = -EINVAL;
+		goto out;
+	}
+	if (!strcmp(trx_path, "-")) {
+		fprintf(stderr, "Patching stdin is unsupported\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	in = fopen(in_path, "r");
+	if (!in || fstat(fileno(in), &st)) {
+		fprintf(stderr, "Couldn't open %s\n", in_path);
+		err = -EACCES;
+		goto err_close_in;
+	}
+
+	old_data = malloc(st.st_size);
+	new_data = malloc(st.st_size);
+	if (!old_data || !new_data) {
+		err = -ENOMEM;
+		goto err_free;
+	}
+
+	if (fread(new_data, 1, st.st_size, in) != st.st_size) {
+		fprintf(stderr, "Couldn't read %s\n", in_path);
+		err = -EIO;
+		goto err_free;
+	}
+
+	err = otrx_open_parse(trx_path, "r+", &otrx);
+	if (err) {
+		fprintf(stderr, "Couldn't open & parse %s: %d\n", trx_path, err);
+		err = -EACCES;
+		goto err_free;
+	}
+
+	length = le32_to_cpu(otrx.hdr.length);
+	if (offset < TRX_FLAGS_OFFSET || offset + st.st_size > length) {
+		fprintf(stderr, "Patch 0x%lx-0x%lx doesn't fit in CRC covered range 0x%x-0x%zx\n",
+			offset, offset + (long)st.st_size, TRX_FLAGS_OFFSET, length);
+		err = -EINVAL;
+		goto err_close;
+	}
+
+	fseek(otrx.fp, trx_offset + offset, SEEK_SET);
+	if (fread(old_data, 1, st.st_size, otrx.fp) != st.st_size) {
+		fprintf(stderr, "Couldn't read %zd B of data from %s\n", (size_t)st.st_size, trx_path);
+		err = -EIO;
+		goto err_close;
+	}
+
+	/* Update CRC using only the replaced bytes, the rest isn't read */
+	crc32 = crc32_le_patch(le32_to_cpu(otrx.hdr.crc32), length - TRX_FLAGS_OFFSET,
+			       offset - TRX_FLAGS_OFFSET, old_data, new_data, st.st_size);
+	crc32 = cpu_to_le32(crc32);
+
+	fseek(otrx.fp, trx_offset + offset, SEEK_SET);
+	bytes = fwrite(new_data, 1, st.st_size, otrx.fp);
+	if (bytes != st.st_size) {
+		fprintf(stderr, "Couldn't write patch to %s\n", trx_path);
+		err = -EIO;
+		goto err_close;
+	}
+
+	fseek(otrx.fp, trx_offset + offsetof(struct trx_header, crc32), SEEK_SET);
+	if (fwrite(&crc32, 1, sizeof(crc32), otrx.fp) != sizeof(crc32)) {
+		fprintf(stderr, "Couldn't write TRX header to %s\n", trx_path);
+		err = -EIO;
+	}
+
+err_close:
+	otrx_close(otrx.fp);
+err_free:
+	free(new_data);
+	free(old_data);
+err_close_in:
+	if (in)
+		fclose(in);
+out:
+	return err;
+}
+
 /**************************************************
  * Start
  **************************************************/
@@ -657,6 +836,9 @@ static void usage() {
 	printf("\t-A file\t\t\t\t[partition] append current partition with content copied from file\n");
 	printf("\t-a alignment\t\t\t[partition] align current partition\n");
 	printf("\t-b offset\t\t\t[partition] append zeros to partition till reaching absolute offset\n");
+	printf("\t-m file\t\t\t\twrite erase block hash manifest of the TRX to file\n");
+	printf("\t-D device\t\t\talso write the TRX to device, skipping erase blocks that match\n");
+	printf("\t-E size\t\t\t\terase block size for -m and -D (default: 0x10000)\n");
 	printf("\n");
 	printf("Extracting from TRX file:\n");
 	printf("\totrx extract <file> [options]\textract partitions from TRX file\n");
@@ -664,6 +846,18 @@ static void usage() {
 	printf("\t-1 file\t\t\t\tfile to extract 1st partition to (optional)\n");
 	printf("\t-2 file\t\t\t\tfile to extract 2nd partition to (optional)\n");
 	printf("\t-3 file\t\t\t\tfile to extract 3rd partition to (optional)\n");
+	printf("\n");
+	printf("Editing TRX header in place:\n");
+	printf("\totrx edit <file> [options]\tupdate header fields and CRC32 without rewriting data\n");
+	printf("\t-o offset\t\t\toffset of TRX data in file (default: 0)\n");
+	printf("\t-F flags\t\t\tnew flags value\n");
+	printf("\t-V version\t\t\tnew version value\n");
+	printf("\n");
+	printf("Patching TRX data in place:\n");
+	printf("\totrx patch <file> [options]\treplace bytes and update CRC32 without rereading data\n");
+	printf("\t-o offset\t\t\toffset of TRX data in file (default: 0)\n");
+	printf("\t-p offset\t\t\toffset of the patch relative to TRX start\n");
+	printf("\t-f file\t\t\t\tfile with bytes to write at patch offset\n");
 }
 
 int main(int argc, char **argv) {
@@ -674,6 +868,10 @@ int main(int argc, char **argv) {
 			return otrx_create(argc, argv);
 		else if (!strcmp(argv[1], "extract"))
 			return otrx_extract(argc, argv);
+		else if (!strcmp(argv[1], "edit"))
+			return otrx_edit(argc, argv);
+		else if (!strcmp(argv[1], "patch"))
+			return otrx_patch(argc, argv);
 	}
 
 	usage();
@@ -20,10 +20,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include "cyg_crc.h"
+#include "fwdev.h"
+#include "fwmanifest.h"
 
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define cpu_to_le16(x) bswap_16(x)
@@ -171,6 +174,9 @@ bool ignore_null_sized_partition = false;
 bool use_guid_partition_table = false;
 struct partinfo parts[GPT_ENTRY_MAX];
 char *filename = NULL;
+char *manifest = NULL;
+char *device = NULL;
+size_t erase_block = FW_MANIFEST_BLOCK;
 
 
 /*
@@ -569,7 +575,7 @@ fail:
 static void usage(char *prog)
 {
 	fprintf(stderr, "Usage: %s [-v] [-n] [-g] -h <heads> -s <sectors> -o <outputfile>\n"
-			"          [-a 0..4] [-l <align kB>] [-G <guid>]\n"
+			"          [-a 0..4] [-l <align kB>] [-G <guid>] [-m <manifest>] [-D <device>] [-E <erase block>]\n"
 			"          [[-t <type> | -T <GPT part type>] [-r] [-N <name>] -p <size>[@<start>]...] \n", prog);
 	exit(EXIT_FAILURE);
 }
@@ -603,11 +609,12 @@ int main (int argc, char **argv)
 	int part = 0;
 	char *name = NULL;
 	unsigned short int hybrid = 0, required = 0;
+	int ret;
 	uint32_t signature = 0x5452574F; /* 'OWRT' */
 	guid_t guid = GUID_INIT( signature, 0x2211, 0x4433, \
 			0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0x00);
 
-	while ((ch = getopt(argc, argv, "h:s:p:a:t:T:o:vnHN:gl:rS:G:")) != -1) {
+	while ((ch = getopt(argc, argv, "h:s:p:a:t:T:o:vnHN:gl:rS:G:m:D:E:")) != -1) {
 		switch (ch) {
 		case 'o':
 			filename = optarg;
@@ -691,6 +698,19 @@ int main (int argc, char **argv)
 				exit(EXIT_FAILURE);
 			}
 			break;
+		case 'm':
+			manifest = optarg;
+			break;
+		case 'D':
+			device = optarg;
+			break;
+		case 'E':
+			erase_block = strtoul(optarg, NULL, 0);
+			if (!erase_block) {
+				fputs("Invalid erase block size\n", stderr);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case '?':
 		default:
 			usage(argv[0]);
@@ -703,8 +723,28 @@ int main (int argc, char **argv)
 	if (use_guid_partition_table) {
 		heads = 254;
 		sectors = 63;
-		return gen_gptable(signature, guid, part) ? EXIT_FAILURE : EXIT_SUCCESS;
+		ret = gen_gptable(signature, guid, part);
+	} else {
+		ret = gen_ptable(signature, part);
+	}
+	if (ret)
+		return EXIT_FAILURE;
+
+	/* the tables are written with seeks, hash the finished file */
+	if (manifest && fw_manifest_write_file(manifest, filename, erase_block)) {
+		fprintf(stderr, "Can't write manifest '%s'\n", manifest);
+		return EXIT_FAILURE;
+	}
+
+	if (device) {
+		struct fw_dev_result res;
+
+		if (fw_dev_write_file(device, filename, erase_block, &res)) {
+			fprintf(stderr, "Can't write to device '%s': %s\n", device, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		fprintf(stderr, "wrote %zu of %zu erase blocks to '%s'\n", res.written, res.blocks, device);
 	}
 
-	return gen_ptable(signature, part) ? EXIT_FAILURE : EXIT_SUCCESS;
+	return EXIT_SUCCESS;
 }
@@ -18,6 +18,7 @@
 #include <string.h>
 #include <arpa/inet.h>
 
+#include "fwread.h"
 #include "md5.h"
 #include "seama.h"
 
@@ -112,43 +113,41 @@ static int parse_args(int argc, char * argv[])
 static size_t calculate_digest(FILE * fh, size_t size, uint8_t * digest)
 {
 	MD5_CTX ctx;
-	size_t bytes_left, bytes_read, i;
-	uint8_t buf[MAX_SEAMA_META_SIZE];
+	struct fw_reader *rd;
+	const uint8_t *buf;
+	size_t bytes_read, i;
 
-	bytes_left = size ? size : sizeof(buf);
 	bytes_read = 0;
 
 	MD5_Init(&ctx);
-	while (!feof(fh) && !ferror(fh) && bytes_left > 0)
+	rd = fw_reader_open(fh, size ? size : FW_READ_ALL);
+	if (rd)
 	{
-		i = bytes_left < sizeof(buf) ? bytes_left : sizeof(buf);
-		i = fread(buf, sizeof(char), i, fh);
-		if (i > 0)
+		while ((i = fw_reader_next(rd, &buf)) > 0)
 		{
 			MD5_Update(&ctx, buf, i);
 			bytes_read += i;
 		}
-		if (size) bytes_left -= i;
+		fw_reader_close(rd);
 	}
 	MD5_Final(digest, &ctx);
 	return bytes_read;
 }
 
-#define READ_BUFF_SIZE 8*1024
 static size_t copy_file(FILE * to, FILE * from)
 {
 	size_t i, fsize = 0;
-	uint8_t buf[READ_BUFF_SIZE];
+	struct fw_reader *rd;
+	const uint8_t *buf;
 
-	while (!feof(from) && !ferror(from))
+	rd = fw_reader_open(from, FW_READ_ALL);
+	if (!rd) return 0;
+	while ((i = fw_reader_next(rd, &buf)) > 0)
 	{
-		i = fread(buf, sizeof(uint8_t), READ_BUFF_SIZE, from);
-		if (i > 0)
-		{
-			fsize += i;
-			fwrite(buf, sizeof(uint8_t), i, to);
-		}
+		fsize += i;
+		fwrite(buf, sizeof(uint8_t), i, to);
 	}
+	fw_reader_close(rd);
 	return fsize;
 }
 
@@ -13,9 +13,12 @@
 */
 
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -27,10 +30,15 @@
 
 #include <arpa/inet.h>
 
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <limits.h>
 
+#include "fwcopy.h"
+#include "fwmanifest.h"
+#include "fwstats.h"
 #include "md5.h"
 
 
@@ -167,6 +175,11 @@ struct safeloader_image_info {
 	enum safeloader_image_type type;
 	size_t payload_offset;
 	struct flash_partition_entry entries[MAX_PARTITIONS];
+
+	/* the image is mapped, only the pages actually looked at are read */
+	int fd;
+	uint8_t *data;
+	size_t size;
 };
 
 #define SAFELOADER_PREAMBLE_SIZE	0x14
@@ -196,8 +209,13 @@ static const uint8_t md5_salt[16] = {
 };
 
 
-/** Firmware layout table */
-static struct device_info boards[] = {
+/**
+   Firmware layout table
+
+   Read-only and shared by all builds; build_image() adjusts a copy of
+   the selected entry.
+*/
+static const struct device_info boards[] = {
 	/** Firmware layout for the CPE210/220 V1 */
 	{
 		.id     = "CPE210",
@@ -3311,6 +3329,74 @@ static struct device_info boards[] = {
 	} while (0)
 
 
+/** Size of a regular arena chunk; larger requests get a chunk of their own */
+#define ARENA_CHUNK_SIZE	0x10000
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	uint8_t data[];
+};
+
+/** Arena holding all partition entries and names of the current build */
+static struct arena_chunk *arena;
+
+/** Allocates a new arena chunk with room for `size` bytes */
+static struct arena_chunk *arena_new_chunk(size_t size) {
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+	if (!chunk)
+		error(1, errno, "malloc");
+	fwstats_alloc(sizeof(*chunk) + size);
+
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+/** Allocates `len` bytes from the arena, released only by arena_reset() */
+static void * arena_alloc(size_t len) {
+	struct arena_chunk *chunk;
+	void *ptr;
+
+	len = ALIGN(len, sizeof(void *));
+
+	if (len > ARENA_CHUNK_SIZE / 4) {
+		/* Keep the current chunk at the head for small allocations */
+		chunk = arena_new_chunk(len);
+		if (arena) {
+			chunk->next = arena->next;
+			arena->next = chunk;
+		} else {
+			chunk->next = NULL;
+			arena = chunk;
+		}
+	} else if (!arena || arena->size - arena->used < len) {
+		chunk = arena_new_chunk(ARENA_CHUNK_SIZE);
+		chunk->next = arena;
+		arena = chunk;
+	} else {
+		chunk = arena;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += len;
+
+	return ptr;
+}
+
+/** Releases everything allocated from the arena at once */
+static void arena_reset(void) {
+	while (arena) {
+		struct arena_chunk *next = arena->next;
+
+		free(arena);
+		arena = next;
+	}
+}
+
+
 /** Stores a uint32 as big endian */
 static inline void put32(uint8_t *buf, uint32_t val) {
 	buf[0] = val >> 24;
@@ -3339,10 +3425,8 @@ static struct image_partition_entry init_meta_partition_entry(
 	struct image_partition_entry entry = {
 		.name = name,
 		.size = total_len,
-		.data = malloc(total_len)
+		.data = arena_alloc(total_len)
 	};
-	if (!entry.data)
-		error(1, errno, "failed to allocate meta partition entry");
 
 	struct meta_header *header = (struct meta_header *)entry.data;
 	header->length = htonl(data_len);
@@ -3359,9 +3443,7 @@ static struct image_partition_entry init_meta_partition_entry(
 
 /** Allocates a new image partition */
 static struct image_partition_entry alloc_image_partition(const char *name, size_t len) {
-	struct image_partition_entry entry = {name, len, malloc(len)};
-	if (!entry.data)
-		error(1, errno, "malloc");
+	struct image_partition_entry entry = {name, len, arena_alloc(len)};
 
 	return entry;
 }
@@ -3383,17 +3465,10 @@ static void set_partition_names(struct device_info *info)
 		info->partition_names.extra_para = "extra-para";
 }
 
-/** Frees an image partition */
-static void free_image_partition(struct image_partition_entry *entry)
-{
-	void *data = entry->data;
-
-	entry->name = NULL;
-	entry->size = 0;
-	entry->data = NULL;
 
-	free(data);
-}
+/** Erase block hash manifest written next to a built image */
+static const char *manifest = NULL;
+static size_t manifest_block = FW_MANIFEST_BLOCK;
 
 static time_t source_date_epoch = -1;
 static void set_source_date_epoch() {
@@ -3531,8 +3606,11 @@ static struct image_partition_entry read_file(const char *part_name, const char
 	if (!file)
 		error(1, errno, "unable to open file `%s'", filename);
 
+	struct fwstats_timer t;
+	fwstats_start(&t, FWSTATS_READ);
 	if (fread(entry.data, statbuf.st_size, 1, file) != 1)
 		error(1, errno, "unable to read file `%s'", filename);
+	fwstats_stop(&t, statbuf.st_size);
 
 	if (add_jffs2_eof) {
 		uint8_t *eof = entry.data + statbuf.st_size, *end = entry.data+entry.size;
@@ -3605,12 +3683,15 @@ static void put_partitions(uint8_t *buffer, const struct flash_partition_entry *
 
 /** Generates and writes the image MD5 checksum */
 static void put_md5(uint8_t *md5, uint8_t *buffer, unsigned int len) {
+	struct fwstats_timer t;
 	MD5_CTX ctx;
 
+	fwstats_start(&t, FWSTATS_CSUM);
 	MD5_Init(&ctx);
 	MD5_Update(&ctx, md5_salt, (unsigned int)sizeof(md5_salt));
 	MD5_Update(&ctx, buffer, len);
 	MD5_Final(md5, &ctx);
+	fwstats_stop(&t, len);
 }
 
 
@@ -3629,7 +3710,7 @@ static void put_md5(uint8_t *md5, uint8_t *buffer, unsigned int len) {
      1014-1813    Image partition table (2048 bytes, padded with 0xff)
      1814-xxxx    Firmware partitions
 */
-static void * generate_factory_image(struct device_info *info, const struct image_partition_entry *parts, size_t *len) {
+static void * generate_factory_image(const struct device_info *info, const struct image_partition_entry *parts, size_t *len) {
 	*len = SAFELOADER_PAYLOAD_OFFSET + SAFELOADER_PAYLOAD_TABLE_SIZE;
 
 	size_t i;
@@ -3639,6 +3720,7 @@ static void * generate_factory_image(struct device_info *info, const struct imag
 	uint8_t *image = malloc(*len);
 	if (!image)
 		error(1, errno, "malloc");
+	fwstats_alloc(*len);
 
 	memset(image, 0xff, *len);
 	put32(image, *len);
@@ -3662,7 +3744,7 @@ static void * generate_factory_image(struct device_info *info, const struct imag
    should be generalized when TP-LINK starts building its safeloader into hardware with
    different flash layouts.
 */
-static void * generate_sysupgrade_image(struct device_info *info, const struct image_partition_entry *image_parts, size_t *len) {
+static void * generate_sysupgrade_image(const struct device_info *info, const struct image_partition_entry *image_parts, size_t *len) {
 	size_t i, j;
 	size_t flash_first_partition_index = 0;
 	size_t flash_last_partition_index = 0;
@@ -3699,6 +3781,7 @@ static void * generate_sysupgrade_image(struct device_info *info, const struct i
 	uint8_t *image = malloc(*len);
 	if (!image)
 		error(1, errno, "malloc");
+	fwstats_alloc(*len);
 
 	memset(image, 0xff, *len);
 
@@ -3718,6 +3801,88 @@ static void * generate_sysupgrade_image(struct device_info *info, const struct i
 	return image;
 }
 
+/** Returns the offset of the data of parts[index] in the generated image */
+static size_t image_partition_offset(const struct device_info *info, const struct image_partition_entry *parts, size_t index, bool sysupgrade) {
+	size_t i, first = 0;
+
+	if (!sysupgrade) {
+		size_t offset = SAFELOADER_PAYLOAD_OFFSET + SAFELOADER_PAYLOAD_TABLE_SIZE;
+
+		for (i = 0; i < index; i++)
+			offset += parts[i].size;
+
+		return offset;
+	}
+
+	for (i = 0; info->partitions[i].name; i++)
+		if (!strcmp(info->partitions[i].name, info->first_sysupgrade_partition))
+			first = info->partitions[i].base;
+
+	for (i = 0; info->partitions[i].name; i++)
+		if (!strcmp(info->partitions[i].name, parts[index].name))
+			return info->partitions[i].base - first;
+
+	return SIZE_MAX;
+}
+
+/** Writes size bytes of buffer to offset of the output file */
+static void write_buffer(int fd, const uint8_t *buffer, size_t size, off_t offset) {
+	struct fwstats_timer t;
+	size_t total = size;
+	ssize_t n;
+
+	fwstats_start(&t, FWSTATS_WRITE);
+	while (size) {
+		n = pwrite(fd, buffer, size, offset);
+		if (n < 0)
+			error(1, errno, "unable to write output file");
+		buffer += n;
+		offset += n;
+		size -= n;
+	}
+	fwstats_stop(&t, total);
+}
+
+/**
+   Writes the generated image to the output file
+
+   The rootfs makes up most of the image and is stored unchanged, so it is
+   copied from its file, which shares the blocks on filesystems that
+   support it when the rootfs lands block aligned (usually the case for
+   sysupgrade images).
+*/
+static void write_image(const char *output, const uint8_t *image, size_t len,
+		const char *rootfs_image, const struct image_partition_entry *rootfs,
+		size_t rootfs_offset) {
+	struct stat statbuf;
+	size_t rootfs_len = 0;
+	int fd, rootfs_fd;
+
+	fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		error(1, errno, "unable to open output file");
+
+	rootfs_fd = open(rootfs_image, O_RDONLY);
+	if (rootfs_fd >= 0 && !fstat(rootfs_fd, &statbuf) &&
+	    (size_t)statbuf.st_size <= rootfs->size &&
+	    rootfs_offset <= len && (size_t)statbuf.st_size <= len - rootfs_offset &&
+	    !memcmp(image + rootfs_offset, rootfs->data, statbuf.st_size))
+		rootfs_len = statbuf.st_size;
+	else
+		rootfs_offset = len;
+
+	write_buffer(fd, image, rootfs_offset, 0);
+	if (rootfs_len && fw_copy_range(rootfs_fd, 0, fd, rootfs_offset, rootfs_len))
+		error(1, errno, "unable to write output file");
+	write_buffer(fd, image + rootfs_offset + rootfs_len,
+		len - rootfs_offset - rootfs_len, rootfs_offset + rootfs_len);
+
+	if (rootfs_fd >= 0)
+		close(rootfs_fd);
+	if (close(fd))
+		error(1, errno, "unable to write output file");
+}
+
 /** Generates an image according to a given layout and writes it to a file */
 static void build_image(const char *output,
 		const char *kernel_image,
@@ -3725,8 +3890,11 @@ static void build_image(const char *output,
 		uint32_t rev,
 		bool add_jffs2_eof,
 		bool sysupgrade,
-		struct device_info *info) {
+		const struct device_info *board) {
 
+	/* Per-build layout, the file-system partition gets inserted here */
+	struct device_info layout = *board;
+	struct device_info *info = &layout;
 	size_t i;
 
 	struct image_partition_entry parts[7] = {};
@@ -3822,19 +3990,14 @@ static void build_image(const char *output,
 	else
 		image = generate_factory_image(info, parts, &len);
 
-	FILE *file = fopen(output, "wb");
-	if (!file)
-		error(1, errno, "unable to open output file");
+	write_image(output, image, len, rootfs_image, &parts[4],
+		image_partition_offset(info, parts, 4, sysupgrade));
 
-	if (fwrite(image, len, 1, file) != 1)
-		error(1, 0, "unable to write output file");
-
-	fclose(file);
+	if (manifest && fw_manifest_write(manifest, image, len, manifest_block))
+		error(1, errno, "unable to write manifest `%s'", manifest);
 
 	free(image);
-
-	for (i = 0; parts[i].name; i++)
-		free_image_partition(&parts[i]);
+	arena_reset();
 }
 
 /** Usage output */
@@ -3855,18 +4018,22 @@ static void usage(const char *argv0) {
 		"  -V <rev>        sets the revision number to <rev>\n"
 		"  -j              add jffs2 end-of-filesystem markers\n"
 		"  -S              create sysupgrade instead of factory image\n"
+		"  -m <file>       write an erase block hash manifest to <file>\n"
+		"  -E <size>       erase block size of the manifest (default 0x10000)\n"
 		"Extract an old image:\n"
 		"  -x <file>       extract all oem firmware partition\n"
 		"  -d <dir>        destination to extract the firmware partition\n"
-		"  -z <file>       convert an oem firmware into a sysupgade file. Use -o for output file\n",
+		"  -z <file>       convert an oem firmware into a sysupgade file. Use -o for output file\n"
+		"Edit a factory image in place:\n"
+		"  -e <file>       update soft-version revision (-V) and checksum of <file>\n",
 		argv0
 	);
 };
 
 
-static struct device_info *find_board(const char *id)
+static const struct device_info *find_board(const char *id)
 {
-	struct device_info *board = NULL;
+	const struct device_info *board = NULL;
 
 	for (board = boards; board->id != NULL; board++)
 		if (strcasecmp(id, board->id) == 0)
@@ -3895,12 +4062,7 @@ static int add_flash_partition(
 		error(1, 0, "No free flash part entry available.");
 	}
 
-	part_list->name = calloc(1, strlen(name) + 1);
-	if (!part_list->name) {
-		error(1, 0, "Unable to allocate memory");
-	}
-
-	memcpy((char *)part_list->name, name, strlen(name));
+	part_list->name = strcpy(arena_alloc(strlen(name) + 1), name);
 	part_list->base = base;
 	part_list->size = size;
 
@@ -3914,7 +4076,7 @@ enum PARTITION_TABLE_TYPE {
 };
 
 static int read_partition_table(
-		FILE *file, long offset,
+		const struct safeloader_image_info *image, size_t offset,
 		struct flash_partition_entry *entries, size_t max_entries,
 		int type)
 {
@@ -3937,12 +4099,10 @@ static int read_partition_table(
 		error(1, 0, "Invalid partition table");
 	}
 
-	if (fseek(file, offset, SEEK_SET) < 0)
-		error(1, errno, "Can not seek in the firmware");
-
-	if (fread(buf, sizeof(buf), 1, file) != 1)
-		error(1, errno, "Can not read fwup-ptn from the firmware");
+	if (offset > image->size || image->size - offset < sizeof(buf))
+		error(1, 0, "Can not read fwup-ptn from the firmware");
 
+	memcpy(buf, image->data + offset, sizeof(buf) - 1);
 	buf[sizeof(buf) - 1] = '\0';
 
 	/* look for the partition header */
@@ -4019,41 +4179,32 @@ static int read_partition_table(
 	return 0;
 }
 
-static void safeloader_read_partition(FILE *input_file, size_t payload_offset,
+static void safeloader_read_partition(const struct safeloader_image_info *image,
 				      struct flash_partition_entry *entry,
 				      struct image_partition_entry *part)
 {
-	size_t part_size = entry->size;
-	void *part_data = malloc(part_size);
+	size_t offset = image->payload_offset + entry->base;
 
-	if (fseek(input_file, payload_offset, SEEK_SET))
-		error(1, errno, "Failed to seek to partition data");
+	if (offset > image->size || image->size - offset < entry->size)
+		error(1, 0, "Failed to read partition data");
 
-	if (!part_data)
-		error(1, ENOMEM, "Failed to allocate partition data");
-
-	if (fread(part_data, 1, part_size, input_file) < part_size)
-		error(1, errno, "Failed to read partition data");
-
-	part->data = part_data;
-	part->size = part_size;
+	/* partitions are used straight from the mapping */
+	part->data = image->data + offset;
+	part->size = entry->size;
 	part->name = entry->name;
 }
 
-static void safeloader_parse_image(FILE *input_file, struct safeloader_image_info *image)
+static void safeloader_parse_image(struct safeloader_image_info *image)
 {
 	static const char *HEADER_ID_CLOUD = "fw-type:Cloud";
 	static const char *HEADER_ID_QNEW = "?NEW";
 
-	char buf[64];
+	const char *buf;
 
-	if (!input_file)
-		return;
+	if (image->size < SAFELOADER_PREAMBLE_SIZE + 64)
+		error(1, 0, "Can not read image header");
 
-	fseek(input_file, SAFELOADER_PREAMBLE_SIZE, SEEK_SET);
-
-	if (fread(buf, sizeof(buf), 1, input_file) != 1)
-		error(1, errno, "Can not read image header");
+	buf = (const char *) image->data + SAFELOADER_PREAMBLE_SIZE;
 
 	if (memcmp(HEADER_ID_QNEW, &buf[0], strlen(HEADER_ID_QNEW)) == 0)
 		image->type = SAFELOADER_TYPE_QNEW;
@@ -4076,52 +4227,69 @@ static void safeloader_parse_image(FILE *input_file, struct safeloader_image_inf
 	}
 
 	/* Parse image partition table */
-	read_partition_table(input_file, image->payload_offset, &image->entries[0],
+	read_partition_table(image, image->payload_offset, &image->entries[0],
 			     MAX_PARTITIONS, PARTITION_TABLE_FWUP);
 }
 
+/** Maps an existing image and parses its header and partition table */
+static void safeloader_open_image(const char *input, bool writable,
+				  struct safeloader_image_info *image)
+{
+	struct stat statbuf;
+
+	image->fd = open(input, writable ? O_RDWR : O_RDONLY);
+	if (image->fd < 0)
+		error(1, errno, "Can not open input firmware %s", input);
+
+	if (fstat(image->fd, &statbuf))
+		error(1, errno, "Can not stat input firmware %s", input);
+
+	image->size = statbuf.st_size;
+	image->data = mmap(NULL, image->size,
+			   PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED,
+			   image->fd, 0);
+	if (image->data == MAP_FAILED)
+		error(1, errno, "Can not map input firmware %s", input);
+
+	safeloader_parse_image(image);
+}
+
+static void safeloader_close_image(struct safeloader_image_info *image)
+{
+	munmap(image->data, image->size);
+	close(image->fd);
+}
+
+/** Copies a partition of the image to output_offset of the output file */
 static void write_partition(
-		FILE *input_file,
-		size_t firmware_offset,
+		const struct safeloader_image_info *image,
 		struct flash_partition_entry *entry,
-		FILE *output_file)
+		int output_fd, off_t output_offset)
 {
-	char buf[4096];
-	size_t offset;
-
-	fseek(input_file, entry->base + firmware_offset, SEEK_SET);
+	off_t offset = image->payload_offset + entry->base;
+	size_t size = entry->size;
 
-	for (offset = 0; sizeof(buf) + offset <= entry->size; offset += sizeof(buf)) {
-		if (fread(buf, sizeof(buf), 1, input_file) != 1)
-			error(1, errno, "Can not read partition from input_file");
+	if (offset > image->size || image->size - offset < size)
+		error(1, 0, "Can not read partition from input_file");
 
-		if (fwrite(buf, sizeof(buf), 1, output_file) != 1)
-			error(1, errno, "Can not write partition to output_file");
-	}
-	/* write last chunk smaller than buffer */
-	if (offset < entry->size) {
-		offset = entry->size - offset;
-		if (fread(buf, offset, 1, input_file) != 1)
-			error(1, errno, "Can not read partition from input_file");
-		if (fwrite(buf, offset, 1, output_file) != 1)
-			error(1, errno, "Can not write partition to output_file");
-	}
+	if (fw_copy_range(image->fd, offset, output_fd, output_offset, size))
+		error(1, errno, "Can not write partition to output_file");
 }
 
-static int extract_firmware_partition(FILE *input_file, size_t firmware_offset, struct flash_partition_entry *entry, const char *output_directory)
+static int extract_firmware_partition(const struct safeloader_image_info *image, struct flash_partition_entry *entry, const char *output_directory)
 {
-	FILE *output_file;
+	int output_fd;
 	char output[PATH_MAX];
 
 	snprintf(output, PATH_MAX, "%s/%s", output_directory, entry->name);
-	output_file = fopen(output, "wb+");
-	if (output_file == NULL) {
+	output_fd = open(output, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (output_fd < 0) {
 		error(1, errno, "Can not open output file %s", output);
 	}
 
-	write_partition(input_file, firmware_offset, entry, output_file);
+	write_partition(image, entry, output_fd, 0);
 
-	fclose(output_file);
+	close(output_fd);
 
 	return 0;
 }
@@ -4131,7 +4299,6 @@ static int extract_firmware(const char *input, const char *output_directory)
 {
 	struct safeloader_image_info info = {};
 	struct stat statbuf;
-	FILE *input_file;
 
 	/* check input file */
 	if (stat(input, &statbuf)) {
@@ -4147,11 +4314,13 @@ static int extract_firmware(const char *input, const char *output_directory)
 		error(1, errno, "Given output directory is not a directory %s", output_directory);
 	}
 
-	input_file = fopen(input, "rb");
-	safeloader_parse_image(input_file, &info);
+	safeloader_open_image(input, false, &info);
 
 	for (size_t i = 0; i < MAX_PARTITIONS && info.entries[i].name; i++)
-		extract_firmware_partition(input_file, info.payload_offset, &info.entries[i], output_directory);
+		extract_firmware_partition(&info, &info.entries[i], output_directory);
+
+	safeloader_close_image(&info);
+	arena_reset();
 
 	return 0;
 }
@@ -4177,21 +4346,15 @@ static int firmware_info(const char *input)
 	struct safeloader_image_info info = {};
 	struct image_partition_entry part = {};
 	struct flash_partition_entry *e;
-	FILE *input_file;
-
-	input_file = fopen(input, "rb");
 
-	safeloader_parse_image(input_file, &info);
+	safeloader_open_image(input, false, &info);
 
 	if (info.type == SAFELOADER_TYPE_VENDOR) {
-		char buf[SAFELOADER_HEADER_SIZE] = {};
+		const char *buf = (const char *) info.data + SAFELOADER_PREAMBLE_SIZE + sizeof(uint32_t);
 		uint32_t vendor_size;
 
-		fseek(input_file, SAFELOADER_PREAMBLE_SIZE, SEEK_SET);
-		fread(&vendor_size, sizeof(uint32_t), 1, input_file);
-
-		vendor_size = ntohl(vendor_size);
-		fread(buf, vendor_size, 1, input_file);
+		/* the type check guarantees it fits into the header */
+		vendor_size = ntohl(*(uint32_t *) (info.data + SAFELOADER_PREAMBLE_SIZE));
 
 		printf("Firmware vendor string:\n");
 		fwrite(buf, strnlen(buf, vendor_size), 1, stdout);
@@ -4213,7 +4376,7 @@ static int firmware_info(const char *input)
 		size_t data_len;
 		bool isstr;
 
-		safeloader_read_partition(input_file, info.payload_offset + e->base, e, &part);
+		safeloader_read_partition(&info, e, &part);
 		data_len = ntohl(((struct meta_header *) part.data)->length);
 		buf = part.data + sizeof(struct meta_header);
 
@@ -4237,22 +4400,18 @@ static int firmware_info(const char *input)
 		} else {
 			printf("Failed to parse data\n");
 		}
-
-		free_image_partition(&part);
 	}
 
 	e = find_partition(&info.entries[0], MAX_PARTITIONS, "support-list", NULL);
 	if (e) {
 		size_t data_len;
 
-		safeloader_read_partition(input_file, info.payload_offset + e->base, e, &part);
+		safeloader_read_partition(&info, e, &part);
 		data_len = ntohl(((struct meta_header *) part.data)->length);
 
 		printf("\n[Support list]\n");
 		fwrite(part.data + sizeof(struct meta_header), data_len, 1, stdout);
 		printf("\n");
-
-		free_image_partition(&part);
 	}
 
 	e = find_partition(&info.entries[0], MAX_PARTITIONS, "partition-table", NULL);
@@ -4260,7 +4419,7 @@ static int firmware_info(const char *input)
 		size_t flash_table_offset = info.payload_offset + e->base + 4;
 		struct flash_partition_entry parts[MAX_PARTITIONS] = {};
 
-		if (read_partition_table(input_file, flash_table_offset, parts, MAX_PARTITIONS, PARTITION_TABLE_FLASH))
+		if (read_partition_table(&info, flash_table_offset, parts, MAX_PARTITIONS, PARTITION_TABLE_FLASH))
 			error(1, 0, "Error can not read the partition table (partition)");
 
 		printf("\n[Partition table]\n");
@@ -4271,28 +4430,37 @@ static int firmware_info(const char *input)
 			printf("%08x %08x %s\n", e->base, e->size, e->name);
 	}
 
-	fclose(input_file);
+	safeloader_close_image(&info);
+	arena_reset();
 
 	return 0;
 }
 
-static void write_ff(FILE *output_file, size_t size)
+/** Fills size bytes at offset of the output file with 0xff */
+static void write_ff(int output_fd, off_t offset, size_t size)
 {
-	char buf[4096];
-	size_t offset;
+	static uint8_t buf[0x10000];
+	struct iovec iov[64];
+	size_t len, i;
+	ssize_t n;
 
 	memset(buf, 0xff, sizeof(buf));
 
-	for (offset = 0; offset + sizeof(buf) < size ; offset += sizeof(buf)) {
-		if (fwrite(buf, sizeof(buf), 1, output_file) != 1)
+	/* the same buffer is handed out repeatedly, a few MB per syscall */
+	while (size) {
+		len = 0;
+		for (i = 0; i < sizeof(iov) / sizeof(iov[0]) && len < size; i++) {
+			iov[i].iov_base = buf;
+			iov[i].iov_len = size - len < sizeof(buf) ? size - len : sizeof(buf);
+			len += iov[i].iov_len;
+		}
+
+		n = pwritev(output_fd, iov, i, offset);
+		if (n <= 0)
 			error(1, errno, "Can not write 0xff to output_file");
-	}
 
-	/* write last chunk smaller than buffer */
-	if (offset < size) {
-		offset = size - offset;
-		if (fwrite(buf, offset, 1, output_file) != 1)
-			error(1, errno, "Can not write partition to output_file");
+		offset += n;
+		size -= n;
 	}
 }
 
@@ -4306,26 +4474,14 @@ static void convert_firmware(const char *input, const char *output)
 	struct flash_partition_entry *fwup_os_image;
 	struct safeloader_image_info info = {};
 	size_t flash_table_offset;
-	struct stat statbuf;
-	FILE *output_file;
-	FILE *input_file;
+	int output_fd;
 
-	/* check input file */
-	if (stat(input, &statbuf)) {
-		error(1, errno, "Can not read input firmware %s", input);
-	}
+	safeloader_open_image(input, false, &info);
 
-	input_file = fopen(input, "rb");
-	if (!input_file)
-		error(1, 0, "Can not open input firmware %s", input);
-
-	output_file = fopen(output, "wb");
-	if (!output_file)
+	output_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (output_fd < 0)
 		error(1, 0, "Can not open output firmware %s", output);
 
-	input_file = fopen(input, "rb");
-	safeloader_parse_image(input_file, &info);
-
 	fwup_os_image = find_partition(info.entries, MAX_PARTITIONS,
 			"os-image", "Error can not find os-image partition (fwup)");
 	fwup_file_system = find_partition(info.entries, MAX_PARTITIONS,
@@ -4335,7 +4491,7 @@ static void convert_firmware(const char *input, const char *output)
 
 	/* the flash partition table has a 0x00000004 magic haeder */
 	flash_table_offset = info.payload_offset + fwup_partition_table->base + 4;
-	if (read_partition_table(input_file, flash_table_offset, flash, MAX_PARTITIONS, PARTITION_TABLE_FLASH) != 0)
+	if (read_partition_table(&info, flash_table_offset, flash, MAX_PARTITIONS, PARTITION_TABLE_FLASH) != 0)
 		error(1, 0, "Error can not read the partition table (flash)");
 
 	flash_os_image = find_partition(flash, MAX_PARTITIONS,
@@ -4344,29 +4500,84 @@ static void convert_firmware(const char *input, const char *output)
 			"file-system", "Error can not find file-system partition (flash)");
 
 	/* write os_image to 0x0 */
-	write_partition(input_file, info.payload_offset, fwup_os_image, output_file);
-	write_ff(output_file, flash_os_image->size - fwup_os_image->size);
+	write_partition(&info, fwup_os_image, output_fd, 0);
+	if (flash_os_image->size > fwup_os_image->size)
+		write_ff(output_fd, fwup_os_image->size,
+			 flash_os_image->size - fwup_os_image->size);
 
 	/* write file-system behind os_image */
-	fseek(output_file, flash_file_system->base - flash_os_image->base, SEEK_SET);
-	write_partition(input_file, info.payload_offset, fwup_file_system, output_file);
+	write_partition(&info, fwup_file_system, output_fd,
+			flash_file_system->base - flash_os_image->base);
 
-	fclose(output_file);
-	fclose(input_file);
+	close(output_fd);
+	safeloader_close_image(&info);
+	arena_reset();
+}
+
+/**
+   Updates the soft-version revision of a factory image in place
+
+   The MD5 covers the whole image following the preamble, so it has to be
+   recomputed, but the image is hashed straight from a shared mapping and
+   nothing except the soft-version revision and the checksum is rewritten.
+*/
+static void edit_firmware(const char *input, uint32_t rev)
+{
+	struct safeloader_image_info info = {};
+	struct flash_partition_entry *e;
+	struct soft_version *s;
+	uint8_t *image;
+	size_t data_len;
+	size_t offset;
+	size_t len;
+
+	safeloader_open_image(input, true, &info);
+	if (info.type == SAFELOADER_TYPE_QNEW)
+		error(1, 0, "Editing ?NEW type images is not supported");
+
+	e = find_partition(info.entries, MAX_PARTITIONS, "soft-version",
+			"Error can not find soft-version partition");
+
+	image = info.data;
+	madvise(image, info.size, MADV_SEQUENTIAL);
+
+	len = ntohl(*(uint32_t *)image);
+	if (len < SAFELOADER_PREAMBLE_SIZE || len > info.size)
+		error(1, 0, "Invalid image size 0x%zx in preamble", len);
+
+	offset = info.payload_offset + e->base;
+	if (offset + sizeof(struct meta_header) > len)
+		error(1, 0, "soft-version partition beyond image end");
+
+	data_len = ntohl(((struct meta_header *)(image + offset))->length);
+	if (data_len < offsetof(struct soft_version, compat_level) ||
+	    offset + sizeof(struct meta_header) + data_len > len)
+		error(1, 0, "soft-version partition has no revision field");
+
+	s = (struct soft_version *)(image + offset + sizeof(struct meta_header));
+	if (s->pad1 != 0xff)
+		error(1, 0, "soft-version partition is a text string, can't set revision");
+	s->rev = htonl(rev);
+
+	put_md5(image + 0x04, image + SAFELOADER_PREAMBLE_SIZE, len - SAFELOADER_PREAMBLE_SIZE);
+
+	safeloader_close_image(&info);
+	arena_reset();
 }
 
 int main(int argc, char *argv[]) {
 	const char *info_image = NULL, *board = NULL, *kernel_image = NULL, *rootfs_image = NULL, *output = NULL;
 	const char *extract_image = NULL, *output_directory = NULL, *convert_image = NULL;
-	bool add_jffs2_eof = false, sysupgrade = false;
+	const char *edit_image = NULL;
+	bool add_jffs2_eof = false, sysupgrade = false, set_rev = false;
 	unsigned rev = 0;
-	struct device_info *info;
+	const struct device_info *info;
 	set_source_date_epoch();
 
 	while (true) {
 		int c;
 
-		c = getopt(argc, argv, "i:B:k:r:o:V:jSh:x:d:z:");
+		c = getopt(argc, argv, "i:B:k:r:o:V:jSm:E:h:x:d:z:e:");
 		if (c == -1)
 			break;
 
@@ -4393,6 +4604,7 @@ int main(int argc, char *argv[]) {
 
 		case 'V':
 			sscanf(optarg, "r%u", &rev);
+			set_rev = true;
 			break;
 
 		case 'j':
@@ -4403,6 +4615,16 @@ int main(int argc, char *argv[]) {
 			sysupgrade = true;
 			break;
 
+		case 'm':
+			manifest = optarg;
+			break;
+
+		case 'E':
+			manifest_block = strtoul(optarg, NULL, 0);
+			if (!manifest_block)
+				error(1, 0, "invalid erase block size %s", optarg);
+			break;
+
 		case 'h':
 			usage(argv[0]);
 			return 0;
@@ -4419,6 +4641,10 @@ int main(int argc, char *argv[]) {
 			convert_image = optarg;
 			break;
 
+		case 'e':
+			edit_image = optarg;
+			break;
+
 		default:
 			usage(argv[0]);
 			return 1;
@@ -4437,6 +4663,10 @@ int main(int argc, char *argv[]) {
 		if (!output)
 			error(1, 0, "Can not convert a factory/oem image into sysupgrade image without output file. Use -o <file>");
 		convert_firmware(convert_image, output);
+	} else if (edit_image) {
+		if (!set_rev)
+			error(1, 0, "Nothing to edit in %s. Use -V <rev>", edit_image);
+		edit_firmware(edit_image, rev);
 	} else {
 		if (!board)
 			error(1, 0, "no board has been specified");
@@ -9,49 +9,26 @@
 #include <string.h>
 #include <unistd.h>
 
-#define szbuf 32768
+#include "crc32.h"
 
-u_int32_t crc_tab[256];
+#define szbuf 32768
 
 u_int32_t chksum_crc32 (FILE *f)
 {
-  register unsigned long crc;
-  unsigned long i, j;
+  uint32_t crc;
+  size_t j;
   char *buffer = malloc(szbuf);
-  char *buf;
 
   crc = 0xFFFFFFFF;
   while (!feof(f))
   {
     j = fread(buffer, 1, szbuf, f);
-    buf = buffer;
-    for (i = 0; i < j; i++)
-      crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab[(crc ^ *buf++) & 0xFF];
+    crc = crc32_le_update(crc, buffer, j);
   }
   free(buffer);
   return crc;
 }
 
-void chksum_crc32gentab ()
-{
-  unsigned long crc, poly;
-  int i, j;
-
-  poly = 0xEDB88320L;
-  for (i = 0; i < 256; i++)
-  {
-    crc = i;
-    for (j = 8; j > 0; j--)
-    {
-      if (crc & 1)
-        crc = (crc >> 1) ^ poly;
-      else
-        crc >>= 1;
-    }
-    crc_tab[i] = crc;
-  }
-}
-
 void usage(char *progname)
 {
   printf("Usage: %s [ -v Version ] [ -d Device_ID ] <input file>\n", progname);
@@ -111,8 +88,6 @@ int main(int argc, char *argv[]) {
     opt = getopt( argc, argv, optString );
   }
 
-  chksum_crc32gentab();
-
   filename=argv[optind];
   if (access(filename, W_OK) || access(filename, R_OK))
   {
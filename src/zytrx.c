@@ -22,32 +22,11 @@
 #include <netinet/in.h>
 #include <inttypes.h>
 
-#define BPB 8 /* bits/byte */
-
-static uint32_t crc32[1<<BPB];
-
-static void init_crc32(void)
-{
-	const uint32_t poly = ntohl(0x2083b8ed);
-	int n;
-
-	for (n = 0; n < 1<<BPB; n++) {
-		uint32_t crc = n;
-		int bit;
-
-		for (bit = 0; bit < BPB; bit++)
-			crc = (crc & 1) ? (poly ^ (crc >> 1)) : (crc >> 1);
-		crc32[n] = crc;
-	}
-}
+#include "crc32.h"
 
 static uint32_t crc32buf(const unsigned char *buf, size_t len)
 {
-	uint32_t crc = 0xFFFFFFFF;
-
-	for (; len; len--, buf++)
-		crc = crc32[(uint8_t)crc ^ *buf] ^ (crc >> BPB);
-	return ~crc;
+	return ~crc32_le_update(0xFFFFFFFF, buf, len);
 }
 
 /* HDR0 reversed, to be stored as BE */
@@ -207,7 +186,6 @@ int main(int argc, char **argv)
 	h.len_p = htonl(file_len);
 
 	/* crc fields */
-	init_crc32();
 	crc = crc32buf(input_file, file_len);
 	h.crc32_p = htonl(~crc);
 	crc = crc32buf((unsigned char *)&h, sizeof(h));